@@ -2,16 +2,19 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "console.h"
+#include "perfcounter.h"
 #include "report.h"
 #include "web.h"
 
@@ -26,6 +29,9 @@ static bool prompt_flag = true;
 /* Am I timing a command that has the console blocked? */
 static bool block_timing = false;
 
+/* Report the hardware counters of the commands run by 'time' */
+static int show_counters = 0;
+
 /* Time of day */
 static double first_time, last_time;
 
@@ -40,14 +46,37 @@ typedef struct __rio {
     int count;             /* Unread bytes in internal buffer */
     char *bufptr;          /* Next unread byte in internal buffer */
     char buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *map;             /* Whole file mapped in batch mode, or NULL */
+    size_t map_len;        /* Size of the mapped file */
+    size_t map_pos;        /* Offset of the next line in the mapped file */
     struct __rio *prev;    /* Next element in stack */
 } rio_t;
 
 static rio_t *buf_stack;
 static char linebuf[RIO_BUFSIZE];
 
-/* Maximum file descriptor */
-static int fd_max = 0;
+/* The words of the command line being interpreted. They are split into an
+ * arena which every line reuses, rather than allocated one by one. A word
+ * takes at least two bytes of the arena with its null character. */
+static char arg_arena[RIO_BUFSIZE];
+static char *arg_vec[RIO_BUFSIZE / 2];
+
+/* The commands and the parameters are also found by their names in hash
+ * tables with open addressing, which are kept at most half full */
+typedef struct {
+    const char *name;
+    void *ele;
+} name_slot_t;
+
+typedef struct {
+    name_slot_t *slots;
+    size_t size; /* a power of 2 */
+    size_t count;
+} name_table_t;
+
+#define NAME_TABLE_MIN 64
+
+static name_table_t cmd_table, param_table;
 
 /* Parameters */
 static int err_limit = 5;
@@ -58,6 +87,9 @@ static bool quit_flag = false;
 static char *prompt = "cmd> ";
 static bool has_infile = false;
 
+/* Run the files mapped in memory, see run_batch() */
+static bool batch = false;
+
 /* Optional function to call as part of exit process */
 /* Maximum number of quit functions */
 
@@ -72,6 +104,65 @@ static void pop_file();
 
 static bool interpret_cmda(int argc, char *argv[]);
 
+/* FNV-1a hash of a name */
+static uint32_t name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* The slot of @name, or the empty one where it would be inserted */
+static name_slot_t *table_slot(const name_table_t *table, const char *name)
+{
+    size_t mask = table->size - 1;
+    for (size_t i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        name_slot_t *slot = &table->slots[i];
+        if (!slot->name || !strcmp(slot->name, name))
+            return slot;
+    }
+}
+
+static void *table_find(const name_table_t *table, const char *name)
+{
+    return table->size ? table_slot(table, name)->ele : NULL;
+}
+
+/* Insert the element named @name, which replaces one of the same name */
+static void table_insert(name_table_t *table, const char *name, void *ele)
+{
+    if (2 * (table->count + 1) > table->size) {
+        name_table_t old = *table;
+        table->size = old.size ? old.size * 2 : NAME_TABLE_MIN;
+        table->count = 0;
+        table->slots =
+            calloc_or_fail(table->size, sizeof(name_slot_t), "table_insert");
+        for (size_t i = 0; i < old.size; i++) {
+            if (old.slots[i].name)
+                table_insert(table, old.slots[i].name, old.slots[i].ele);
+        }
+        if (old.slots)
+            free_array(old.slots, old.size, sizeof(name_slot_t));
+    }
+
+    name_slot_t *slot = table_slot(table, name);
+    if (!slot->name)
+        table->count++;
+    slot->name = name;
+    slot->ele = ele;
+}
+
+static void table_free(name_table_t *table)
+{
+    if (table->slots)
+        free_array(table->slots, table->size, sizeof(name_slot_t));
+    table->slots = NULL;
+    table->size = table->count = 0;
+}
+
 /* Add a new command */
 void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
 {
@@ -89,6 +180,7 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
     cmd->param = param;
     cmd->next = next_cmd;
     *last_loc = cmd;
+    table_insert(&cmd_table, name, cmd);
 }
 
 /* Add a new parameter */
@@ -109,53 +201,42 @@ void add_param(char *name, int *valp, char *summary, setter_func_t setter)
     param->setter = setter;
     param->next = next_param;
     *last_loc = param;
+    table_insert(&param_table, name, param);
 }
 
-/* Parse a string into a command line */
-static char **parse_args(char *line, int *argcp)
+/* Parse the @len characters at @line into a command line, whose words are
+ * stored in the arena until the next line is parsed. Return NULL if the words
+ * do not fit in the arena, rather than run a line cut short. */
+static char **parse_args(const char *line, size_t len, int *argcp)
 {
-    /* Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
-    size_t len = strlen(line);
-
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
-
-    char *src = line;
-    char *dst = buf;
+    char *dst = arg_arena;
+    const char *end = arg_arena + sizeof(arg_arena) - 1;
+    const char *line_end = line + len;
     bool skipping = true;
-    int c;
     int argc = 0;
-    while ((c = *src++) != '\0') {
+    while (line < line_end) {
+        int c = *line++;
         if (isspace(c)) {
-            if (!skipping) {
-                /* Hit end of word */
+            if (!skipping && dst < end) {
+                /* Hit end of word, the last one is ended below */
                 *dst++ = '\0';
                 skipping = true;
             }
         } else {
+            if (dst == end)
+                return NULL;
             if (skipping) {
                 /* Hit start of new word */
-                argc++;
+                arg_vec[argc++] = dst;
                 skipping = false;
             }
             *dst++ = c;
         }
     }
+    *dst = '\0';
 
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
-    }
-
-    free_block(buf, len + 1);
     *argcp = argc;
-    return argv;
+    return arg_vec;
 }
 
 static void record_error()
@@ -173,10 +254,8 @@ static bool interpret_cmda(int argc, char *argv[])
     if (argc == 0)
         return true;
     /* Try to find matching command */
-    cmd_element_t *next_cmd = cmd_list;
+    const cmd_element_t *next_cmd = table_find(&cmd_table, argv[0]);
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
         ok = next_cmd->operation(argc, argv);
         if (!ok)
@@ -190,20 +269,27 @@ static bool interpret_cmda(int argc, char *argv[])
     return ok;
 }
 
+/* Execute a command from the @len characters at @line */
+static bool interpret_line(const char *line, size_t len)
+{
+    int argc;
+    char **argv = parse_args(line, len, &argc);
+    if (!argv) {
+        report(1, "Arguments longer than %d characters, line not executed",
+               RIO_BUFSIZE - 1);
+        record_error();
+        return false;
+    }
+    return interpret_cmda(argc, argv);
+}
+
 /* Execute a command from a command line */
 static bool interpret_cmd(char *cmdline)
 {
     if (quit_flag)
         return false;
 
-    int argc;
-    char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
-
-    return ok;
+    return interpret_line(cmdline, strlen(cmdline));
 }
 
 /* Set function to be executed as part of program exit */
@@ -238,6 +324,10 @@ static bool do_quit(int argc, char *argv[])
         p = p->next;
         free_block(ele, sizeof(param_element_t));
     }
+    cmd_list = NULL;
+    param_list = NULL;
+    table_free(&cmd_table);
+    table_free(&param_table);
 
     while (buf_stack)
         pop_file();
@@ -311,7 +401,6 @@ static bool do_option(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         char *name = argv[i];
         int value = 0;
-        bool found = false;
         /* Get value from next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
@@ -320,23 +409,16 @@ static bool do_option(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_element_t *plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
-        }
-        /* Didn't find parameter */
-        if (!found) {
+        /* Find parameter in table */
+        const param_element_t *param = table_find(&param_table, name);
+        if (!param) {
             report(1, "Unknown parameter '%s'", name);
             return false;
         }
+        int oldval = *param->valp;
+        *param->valp = value;
+        if (param->setter)
+            param->setter(oldval);
     }
 
     return true;
@@ -371,6 +453,22 @@ static bool do_log(int argc, char *argv[])
     return result;
 }
 
+/* Report the counters which are available, only the cycles are counted by
+ * cpucycles() instead if none of them is */
+static void report_counters(const perf_sample_t *sample)
+{
+    char buf[RIO_BUFSIZE] = "";
+    size_t len = 0;
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        if (sample->value[i] < 0)
+            continue;
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s = %" PRId64,
+                        len ? ", " : "", perf_counter_names[i],
+                        sample->value[i]);
+    }
+    report(1, "%s%s", buf, perf_available() ? "" : " (cpucycles)");
+}
+
 static bool do_time(int argc, char *argv[])
 {
     double delta = delta_time(&last_time);
@@ -379,12 +477,19 @@ static bool do_time(int argc, char *argv[])
         double elapsed = last_time - first_time;
         report(1, "Elapsed time = %.3f, Delta time = %.3f", elapsed, delta);
     } else {
+        perf_sample_t sample;
+        if (show_counters)
+            perf_start(&sample);
         ok = interpret_cmda(argc - 1, argv + 1);
+        if (show_counters)
+            perf_stop(&sample);
         if (block_flag) {
             block_timing = true;
         } else {
             delta = delta_time(&last_time);
             report(1, "Delta time = %.3f", delta);
+            if (show_counters)
+                report_counters(&sample);
         }
     }
 
@@ -394,6 +499,12 @@ static bool do_time(int argc, char *argv[])
 static bool use_linenoise = true;
 static int web_fd;
 
+static bool web_quit(int argc, char *argv[])
+{
+    web_close();
+    return true;
+}
+
 static bool do_web(int argc, char *argv[])
 {
     int port = 9999;
@@ -407,6 +518,7 @@ static bool do_web(int argc, char *argv[])
         printf("listen on port %d, fd is %d\n", port, web_fd);
         line_set_eventmux_callback(web_eventmux);
         use_linenoise = false;
+        add_quit_helper(web_quit);
     } else {
         perror("ERROR");
         exit(web_fd);
@@ -419,6 +531,8 @@ void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    table_free(&cmd_table);
+    table_free(&param_table);
     err_cnt = 0;
     quit_flag = false;
 
@@ -437,6 +551,8 @@ void init_cmd()
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
     add_param("entropy", &show_entropy, "Show/Hide Shannon entropy", NULL);
+    add_param("counters", &show_counters,
+              "Show/Hide hardware counters of the commands run by time", NULL);
 
     init_in();
     init_time(&last_time);
@@ -454,14 +570,25 @@ static bool push_file(char *fname)
     if (fd < 0)
         return false;
 
-    if (fd > fd_max)
-        fd_max = fd;
-
     rio_t *rnew = malloc_or_fail(sizeof(rio_t), "push_file");
     rnew->fd = fd;
     rnew->count = 0;
     rnew->bufptr = rnew->buf;
+    rnew->map = NULL;
+    rnew->map_len = rnew->map_pos = 0;
     rnew->prev = buf_stack;
+
+    /* A regular file is mapped in batch mode, the others are read */
+    struct stat st;
+    if (batch && fname && !fstat(fd, &st) && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            rnew->map = map;
+            rnew->map_len = st.st_size;
+        }
+    }
     buf_stack = rnew;
 
     return true;
@@ -473,6 +600,8 @@ static void pop_file()
     if (buf_stack) {
         rio_t *rsave = buf_stack;
         buf_stack = rsave->prev;
+        if (rsave->map)
+            munmap(rsave->map, rsave->map_len);
         close(rsave->fd);
         free_block(rsave, sizeof(rio_t));
     }
@@ -508,7 +637,7 @@ static char *readline()
                     /*  Terminate line & return it */
                     *lptr++ = '\n';
                     *lptr++ = '\0';
-                    if (echo) {
+                    if (echo && !batch) {
                         report_noreturn(1, prompt);
                         report_noreturn(1, linebuf);
                     }
@@ -532,7 +661,7 @@ static char *readline()
     }
     *lptr++ = '\0';
 
-    if (echo) {
+    if (echo && !batch) {
         report_noreturn(1, prompt);
         report_noreturn(1, linebuf);
     }
@@ -545,55 +674,51 @@ static bool cmd_done()
     return !buf_stack || quit_flag;
 }
 
-/* Handle command processing in program that uses select as main control loop.
- * Like select, but checks whether command input either present in internal
- * buffer
- * or readable from command input.  If so, that command is executed.
- * Same return as select.  Command input file removed from readfds
- *
- * nfds should be set to the maximum file descriptor for network sockets.
- * If nfds == 0, this indicates that there is no pending network activity
+/* Take the next line of the mapped file on top of the stack, and store its
+ * length without the newline in @lenp. Return NULL and pop the file at its
+ * end. */
+static const char *map_readline(size_t *lenp)
+{
+    rio_t *rio = buf_stack;
+    if (rio->map_pos == rio->map_len) {
+        pop_file();
+        return NULL;
+    }
+
+    const char *line = rio->map + rio->map_pos;
+    size_t rest = rio->map_len - rio->map_pos;
+    const char *nl = memchr(line, '\n', rest);
+    size_t len = nl ? (size_t) (nl - line) : rest;
+    rio->map_pos += nl ? len + 1 : len;
+    *lenp = len;
+    return line;
+}
+
+/* Run the next command of the input, unless the console is blocked. The
+ * commands from the web server are taken while linenoise waits for the
+ * standard input, see web_eventmux().
  */
 int web_connfd;
-static int cmd_select(int nfds,
-                      fd_set *readfds,
-                      fd_set *writefds,
-                      fd_set *exceptfds,
-                      struct timeval *timeout)
-{
-    fd_set local_readset;
-
-    if (cmd_done())
-        return 0;
-
-    if (!block_flag) {
-        int infd;
-        /* Process any commands in input buffer */
-        if (!readfds)
-            readfds = &local_readset;
-
-        /* Add input fd to readset for select */
-        infd = buf_stack->fd;
-        FD_ZERO(readfds);
-        FD_SET(infd, readfds);
-
-        /* If web not ready listen */
-        if (web_fd != -1)
-            FD_SET(web_fd, readfds);
-
-        if (infd == STDIN_FILENO && prompt_flag) {
-            char *cmdline = linenoise(prompt);
-            if (cmdline)
-                interpret_cmd(cmdline);
-            fflush(stdout);
-            prompt_flag = true;
-        } else if (infd != STDIN_FILENO) {
-            char *cmdline = readline();
-            if (cmdline)
-                interpret_cmd(cmdline);
+static void cmd_select(void)
+{
+    if (cmd_done() || block_flag)
+        return;
+
+    if (buf_stack->fd == STDIN_FILENO) {
+        if (!prompt_flag)
+            return;
+        char *cmdline = linenoise(prompt);
+        if (cmdline) {
+            interpret_cmd(cmdline);
+            line_free(cmdline);
         }
+        fflush(stdout);
+        prompt_flag = true;
+    } else {
+        char *cmdline = readline();
+        if (cmdline)
+            interpret_cmd(cmdline);
     }
-    return 0;
 }
 
 bool finish_cmd()
@@ -646,6 +771,35 @@ void completion(const char *buf, line_completions_t *lc)
     }
 }
 
+/* Run the commands of @infile_name back to back without the prompt and the
+ * echo. The file and those it sources are mapped in memory, and every line
+ * is split into the arena straight from the mapping. */
+bool run_batch(char *infile_name)
+{
+    batch = true;
+    if (!push_file(infile_name)) {
+        report(1, "ERROR: Could not open source file '%s'", infile_name);
+        return false;
+    }
+
+    while (!cmd_done()) {
+        if (!buf_stack->map) {
+            /* Not a regular file, read it the usual way */
+            char *cmdline = readline();
+            if (cmdline)
+                interpret_cmd(cmdline);
+            continue;
+        }
+
+        size_t len;
+        const char *line = map_readline(&len);
+        if (line)
+            interpret_line(line, len);
+    }
+
+    return err_cnt == 0;
+}
+
 bool run_console(char *infile_name)
 {
     if (!push_file(infile_name)) {
@@ -661,16 +815,16 @@ bool run_console(char *infile_name)
             line_history_save(HISTORY_FILE); /* Save the history on disk. */
             line_free(cmdline);
             while (buf_stack && buf_stack->fd != STDIN_FILENO)
-                cmd_select(0, NULL, NULL, NULL, NULL);
+                cmd_select();
             has_infile = false;
         }
         if (!use_linenoise) {
             while (!cmd_done())
-                cmd_select(0, NULL, NULL, NULL, NULL);
+                cmd_select();
         }
     } else {
         while (!cmd_done())
-            cmd_select(0, NULL, NULL, NULL, NULL);
+            cmd_select();
     }
 
     return err_cnt == 0;
@@ -2,7 +2,6 @@
 #define LAB0_CONSOLE_H
 
 #include <stdbool.h>
-#include <sys/select.h>
 
 #include "linenoise.h"
 
@@ -68,6 +67,10 @@ bool finish_cmd();
  */
 bool run_console(char *infile_name);
 
+/* Run the commands of infile_name, mapped in memory, without the prompt and
+ * the echo */
+bool run_batch(char *infile_name);
+
 /* Callback function to complete command by linenoise */
 void completion(const char *buf, line_completions_t *lc);
 
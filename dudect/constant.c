@@ -8,9 +8,10 @@
 #include "random.h"
 
 /* Maintain a queue independent from the qtest since
- * we do not want the test to affect the original functionality
+ * we do not want the test to affect the original functionality.
+ * Each of the parallel workers of fixture.c has a queue of its own.
  */
-static struct list_head *l = NULL;
+static __thread struct list_head *l = NULL;
 
 #define dut_new() ((void) (l = q_new()))
 
@@ -36,8 +37,8 @@ static struct list_head *l = NULL;
 
 #define dut_free() ((void) (q_free(l)))
 
-static char random_string[N_MEASURES][8];
-static int random_string_iter = 0;
+static __thread char random_string[N_MEASURES][8];
+static __thread int random_string_iter = 0;
 
 /* Implement the necessary queue interface to simulation */
 void init_dut(void)
@@ -4,6 +4,9 @@
 #include <stdbool.h>
 #include "constant.h"
 
+/* Number of threads taking the measurements, one by one if it is 1 */
+extern int dudect_workers;
+
 /* Interface to test if function is constant */
 #define _(x) bool is_##x##_const(void);
 DUT_FUNCS
@@ -0,0 +1,111 @@
+/**
+ * Hardware performance counters of the calling thread and the threads it
+ * creates, by perf_event_open(2) on Linux.
+ *
+ * The counters are opened on the first use, and each of them which can not be
+ * opened is left out, e.g. if perf_event_paranoid forbids it or the event is
+ * not supported by the CPU. The cycles fall back to cpucycles() then.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cpucycles.h"
+#include "perfcounter.h"
+
+const char *const perf_counter_names[N_PERF_COUNTERS] = {
+#define _(x, type, config) #x,
+    PERF_COUNTERS
+#undef _
+};
+
+static int perf_fd[N_PERF_COUNTERS];
+static bool perf_opened = false;
+
+#if defined(__linux__)
+static int perf_open(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1; /* count the threads of parallel_sort() as well */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void perf_init(void)
+{
+    perf_opened = true;
+#if defined(__linux__)
+#define _(x, type, config) perf_fd[PERF(x)] = perf_open(type, config);
+    PERF_COUNTERS
+#undef _
+#else
+    for (int i = 0; i < N_PERF_COUNTERS; i++)
+        perf_fd[i] = -1;
+#endif
+}
+
+/* Whether any hardware counter can be read */
+bool perf_available(void)
+{
+    if (!perf_opened)
+        perf_init();
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        if (perf_fd[i] >= 0)
+            return true;
+    }
+    return false;
+}
+
+void perf_start(perf_sample_t *sample)
+{
+    if (!perf_opened)
+        perf_init();
+
+    for (int i = 0; i < N_PERF_COUNTERS; i++)
+        sample->value[i] = -1;
+    if (perf_fd[PERF(cycles)] < 0)
+        sample->value[PERF(cycles)] = cpucycles();
+
+#if defined(__linux__)
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        if (perf_fd[i] < 0)
+            continue;
+        ioctl(perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void perf_stop(perf_sample_t *sample)
+{
+#if defined(__linux__)
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        if (perf_fd[i] >= 0)
+            ioctl(perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < N_PERF_COUNTERS; i++) {
+        uint64_t count;
+        if (perf_fd[i] >= 0 &&
+            read(perf_fd[i], &count, sizeof(count)) == sizeof(count))
+            sample->value[i] = count;
+    }
+#endif
+
+    if (perf_fd[PERF(cycles)] < 0)
+        sample->value[PERF(cycles)] = cpucycles() - sample->value[PERF(cycles)];
+}
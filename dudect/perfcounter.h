@@ -0,0 +1,39 @@
+#ifndef DUDECT_PERFCOUNTER_H
+#define DUDECT_PERFCOUNTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The hardware events counted by perf_event_open(2), with the type and the
+ * config of their perf_event_attr */
+#define PERF_COUNTERS                                                      \
+    _(cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES)                \
+    _(instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS)        \
+    _(branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES)      \
+    _(l1d_misses, PERF_TYPE_HW_CACHE,                                      \
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |       \
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+#define PERF(x) PERF_##x
+
+enum {
+#define _(x, type, config) PERF(x),
+    PERF_COUNTERS
+#undef _
+        N_PERF_COUNTERS
+};
+
+/* The counts of a measurement, where a counter which is not available is -1.
+ * The cycles are always counted, by cpucycles() if not by the counter.
+ */
+typedef struct {
+    int64_t value[N_PERF_COUNTERS];
+} perf_sample_t;
+
+extern const char *const perf_counter_names[N_PERF_COUNTERS];
+
+bool perf_available(void);
+void perf_start(perf_sample_t *sample);
+void perf_stop(perf_sample_t *sample);
+
+#endif
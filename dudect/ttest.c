@@ -47,3 +47,24 @@ void t_init(t_context_t *ctx)
     }
     return;
 }
+
+/* Pool the measurements of @other into @ctx, as if they had been pushed into
+ * @ctx one by one. The means and the sums of squared differences are combined
+ * by the parallel algorithm of Chan et al.
+ *
+ * See https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance
+ */
+void t_merge(t_context_t *ctx, const t_context_t *other)
+{
+    for (int class = 0; class < 2; class ++) {
+        double n = ctx->n[class] + other->n[class];
+        if (n == 0)
+            continue;
+
+        double delta = other->mean[class] - ctx->mean[class];
+        ctx->mean[class] += delta * other->n[class] / n;
+        ctx->m2[class] += other->m2[class] +
+                          delta * delta * ctx->n[class] * other->n[class] / n;
+        ctx->n[class] = n;
+    }
+}
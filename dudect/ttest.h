@@ -12,5 +12,6 @@ typedef struct {
 void t_push(t_context_t *ctx, double x, uint8_t class);
 double t_compute(t_context_t *ctx);
 void t_init(t_context_t *ctx);
+void t_merge(t_context_t *ctx, const t_context_t *other);
 
 #endif
@@ -1,5 +1,6 @@
 /* Test support code */
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdint.h>
@@ -8,6 +9,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "random.h"
 #include "report.h"
 
 /* Our program needs to use regular malloc/free */
@@ -30,20 +32,76 @@
 
 /* Data structures used by our code */
 
-/* Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
- */
+/* Header of every allocated block */
 typedef struct __block_element {
-    struct __block_element *next, *prev;
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
-static block_element_t *allocated = NULL;
+/* Keep the addresses of the allocated blocks in an open-addressing hash set
+ * with linear probing, so that cautious mode checks a block in constant time
+ * rather than scanning every allocated block. The table is at most half full.
+ */
+#define LIVE_MIN_CAPACITY 1024
+
+static block_element_t **live_blocks = NULL;
+static size_t live_capacity = 0; /* Always a power of 2 */
 static size_t allocated_count = 0;
 
+/* Freed blocks with small payloads are kept on the free list of their size
+ * class, and handed out again by later allocations of the same class without
+ * going back to libc. Size class c holds the payloads of c * CACHE_CLASS_SIZE
+ * to (c + 1) * CACHE_CLASS_SIZE - 1 bytes, whose blocks are all allocated with
+ * room for the largest of them. Cautious mode keeps nothing, so that every
+ * block freed twice or used after its free is still caught.
+ */
+#define CACHE_CLASS_SIZE 16
+#define CACHE_CLASSES 16
+
+/* The blocks go straight back to libc under AddressSanitizer, which could not
+ * tell a use after free or a double free of a cached block otherwise */
+#if defined(__SANITIZE_ADDRESS__)
+#define CACHE_ENABLED 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CACHE_ENABLED 0
+#endif
+#endif
+#ifndef CACHE_ENABLED
+#define CACHE_ENABLED 1
+#endif
+
+static block_element_t *cache_list[CACHE_CLASSES];
+static int cache_count[CACHE_CLASSES];
+
+/* Maximum number of freed blocks kept for each size class */
+int cache_limit = 1024;
+
+/* The parallel workers of dudect allocate from several threads at once, so
+ * the live block set, the free lists and the counts are guarded by this lock.
+ * It is held only while they are touched, never across anything which could
+ * fault, report or jump out of the function.
+ */
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Whether this thread holds @alloc_lock, so that it can be released if the
+ * time limit jumps out while it is held */
+static __thread bool alloc_lock_held = false;
+
+static inline void alloc_lock_acquire(void)
+{
+    pthread_mutex_lock(&alloc_lock);
+    alloc_lock_held = true;
+}
+
+static inline void alloc_lock_release(void)
+{
+    alloc_lock_held = false;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
@@ -67,10 +125,86 @@ typedef enum {
 
 /* Internal functions */
 
+/* Hash the address of a block into a slot of the live block set */
+static inline size_t live_slot(const block_element_t *b)
+{
+    uint64_t x = (uintptr_t) b;
+    /* Mix the bits since the addresses share the low and high bits */
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x & (live_capacity - 1);
+}
+
+/* Find the slot holding @b, or the empty slot where it would be */
+static size_t live_find(const block_element_t *b)
+{
+    size_t i = live_slot(b);
+    while (live_blocks[i] && live_blocks[i] != b)
+        i = (i + 1) & (live_capacity - 1);
+    return i;
+}
+
+static bool live_contains(const block_element_t *b)
+{
+    return live_capacity && live_blocks[live_find(b)] == b;
+}
+
+/* Add @b to the live block set, return false if the set can not grow */
+static bool live_insert(block_element_t *b)
+{
+    if ((allocated_count + 1) * 2 > live_capacity) {
+        size_t old_capacity = live_capacity;
+        block_element_t **old_blocks = live_blocks;
+        size_t capacity =
+            old_capacity ? old_capacity * 2 : LIVE_MIN_CAPACITY;
+        block_element_t **blocks = calloc(capacity, sizeof(*blocks));
+        if (!blocks)
+            return false;
+
+        live_blocks = blocks;
+        live_capacity = capacity;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_blocks[i])
+                live_blocks[live_find(old_blocks[i])] = old_blocks[i];
+        }
+        free(old_blocks);
+    }
+    live_blocks[live_find(b)] = b;
+    return true;
+}
+
+/* Remove @b from the live block set, return false if it is not there */
+static bool live_remove(const block_element_t *b)
+{
+    if (!live_capacity)
+        return false;
+    size_t i = live_find(b);
+    if (!live_blocks[i])
+        return false;
+
+    /* Shift the following blocks of the probe sequence back into the hole,
+     * which keeps every block reachable without tombstones */
+    size_t mask = live_capacity - 1;
+    for (size_t j = (i + 1) & mask; live_blocks[j]; j = (j + 1) & mask) {
+        size_t home = live_slot(live_blocks[j]);
+        /* Move it unless its home slot lies cyclically in (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            live_blocks[i] = live_blocks[j];
+            i = j;
+        }
+    }
+    live_blocks[i] = NULL;
+    return true;
+}
+
 /* Should this allocation fail? */
 static bool fail_allocation()
 {
-    double weight = (double) random() / RAND_MAX;
+    if (!fail_probability)
+        return false;
+    /* Uniform in [0, 1) from the upper 53 bits */
+    double weight = (double) (prng_next() >> 11) / (double) (1ULL << 53);
     return (weight < 0.01 * fail_probability);
 }
 
@@ -88,13 +222,10 @@ static block_element_t *find_header(void *p)
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
     if (cautious_mode) {
         /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        alloc_lock_acquire();
+        bool live = live_contains(b);
+        alloc_lock_release();
+        if (!live) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
@@ -133,7 +264,19 @@ static void *alloc(alloc_t alloc_type, size_t size)
         return NULL;
     }
 
-    if (fail_allocation()) {
+    size_t class = size / CACHE_CLASS_SIZE;
+    block_element_t *new_block = NULL;
+    alloc_lock_acquire();
+    bool fail = fail_allocation();
+    if (!fail && class < CACHE_CLASSES && cache_list[class]) {
+        /* Reuse a freed block, the next one is kept in its payload */
+        new_block = cache_list[class];
+        cache_list[class] = *(block_element_t **) new_block->payload;
+        cache_count[class]--;
+    }
+    alloc_lock_release();
+
+    if (fail) {
         char *msg_alloc_failure[] = {
             "Malloc returning NULL",
             "Calloc returning NULL",
@@ -142,29 +285,36 @@ static void *alloc(alloc_t alloc_type, size_t size)
         return NULL;
     }
 
-    block_element_t *new_block =
-        malloc(size + sizeof(block_element_t) + sizeof(size_t));
     if (!new_block) {
-        report_event(MSG_FATAL, "Couldn't allocate any more memory");
-        error_occurred = true;
+        size_t capacity =
+            class < CACHE_CLASSES ? (class + 1) * CACHE_CLASS_SIZE : size;
+        new_block = malloc(capacity + sizeof(block_element_t) + sizeof(size_t));
+        if (!new_block) {
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            error_occurred = true;
+            return NULL;
+        }
     }
 
-    // cppcheck-suppress nullPointerRedundantCheck
     new_block->magic_header = MAGICHEADER;
-    // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
     *find_footer(new_block) = MAGICFOOTER;
+
+    alloc_lock_acquire();
+    bool inserted = live_insert(new_block);
+    if (inserted)
+        allocated_count++;
+    alloc_lock_release();
+
+    if (!inserted) {
+        free(new_block);
+        report_event(MSG_FATAL, "Couldn't allocate any more memory");
+        error_occurred = true;
+        return NULL;
+    }
+
     void *p = (void *) &new_block->payload;
     memset(p, !alloc_type * FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
-
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
-    allocated_count++;
 
     return p;
 }
@@ -198,6 +348,10 @@ void test_free(void *p)
         return;
 
     block_element_t *b = find_header(p);
+    /* The block may be free already, releasing it again would corrupt the
+     * free list it is on */
+    if (b->magic_header != MAGICHEADER)
+        return;
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
@@ -206,22 +360,44 @@ void test_free(void *p)
                      p);
         error_occurred = true;
     }
+
+    /* Drop from the live block set, and leave a block which is not there
+     * alone. find_header() has reported it already in cautious mode. */
+    alloc_lock_acquire();
+    bool live = live_remove(b);
+    if (live)
+        allocated_count--;
+    alloc_lock_release();
+    if (!live) {
+        if (!cautious_mode) {
+            report_event(MSG_ERROR,
+                         "Attempted to free unallocated block.  Address = %p",
+                         p);
+            error_occurred = true;
+        }
+        return;
+    }
+
     b->magic_header = MAGICFREE;
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_element_t *bn = b->next;
-    block_element_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
-
+    /* Keep the block for reuse outside cautious mode. The link to the next
+     * one goes into its payload, which has to hold it without reaching the
+     * footer. */
+    size_t class = b->payload_size / CACHE_CLASS_SIZE;
+    if (CACHE_ENABLED && !cautious_mode && class < CACHE_CLASSES &&
+        b->payload_size >= sizeof(block_element_t *)) {
+        alloc_lock_acquire();
+        if (cache_count[class] < cache_limit) {
+            *(block_element_t **) b->payload = cache_list[class];
+            cache_list[class] = b;
+            cache_count[class]++;
+            b = NULL; /* kept on the free list */
+        }
+        alloc_lock_release();
+    }
     free(b);
-    allocated_count--;
 }
 
 // cppcheck-suppress unusedFunction
@@ -258,6 +434,11 @@ void set_noallocate_mode(bool noallocate)
     noallocate_mode = noallocate;
 }
 
+bool is_noallocate_mode()
+{
+    return noallocate_mode;
+}
+
 /* Return whether any errors have occurred since last time set error limit */
 bool error_check()
 {
@@ -274,6 +455,8 @@ bool exception_setup(bool limit_time)
     if (sigsetjmp(env, 1)) {
         /* Got here from longjmp */
         jmp_ready = false;
+        if (alloc_lock_held)
+            alloc_lock_release();
         if (time_limited) {
             alarm(0);
             time_limited = false;
@@ -14,6 +14,9 @@ void *test_malloc(size_t size);
 void *test_calloc(size_t nmemb, size_t size);
 void test_free(void *p);
 char *test_strdup(const char *s);
+
+/* Return whether calls to malloc and free are disallowed at the moment */
+bool is_noallocate_mode();
 /* FIXME: provide test_realloc as well */
 
 #ifdef INTERNAL
@@ -24,6 +27,9 @@ size_t allocation_check();
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Maximum number of freed blocks kept for reuse in each size class */
+extern int cache_limit;
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
@@ -9,6 +9,7 @@
 
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
+                               bool descend,
                                struct list_head *a,
                                struct list_head *b)
 {
@@ -16,7 +17,7 @@ static struct list_head *merge(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
@@ -39,6 +40,7 @@ static struct list_head *merge(void *priv,
 
 static void merge_final(void *priv,
                         list_cmp_func_t cmp,
+                        bool descend,
                         struct list_head *head,
                         struct list_head *a,
                         struct list_head *b)
@@ -51,7 +53,7 @@ static void merge_final(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             tail->next = a;
             a->prev = tail;
             tail = a;
@@ -92,13 +94,88 @@ static void merge_final(void *priv,
     head->prev = tail;
 }
 
-void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+/* Move the last node @tail of the merged list to @removed, and return the
+ * node before it */
+static inline struct list_head *drop_tail(struct list_head *tail,
+                                          struct list_head *removed)
+{
+    struct list_head *prev = tail->prev;
+    list_add_tail(tail, removed);
+    return prev;
+}
+
+/* The final merge like merge_final(), which passes each node in the sorted
+ * order through @filter. The merged list is the stack of the nodes kept, and
+ * the nodes dropped are moved to @removed. */
+static void merge_filter(void *priv,
+                         list_cmp_func_t cmp,
+                         bool descend,
+                         struct list_head *head,
+                         struct list_head *a,
+                         struct list_head *b,
+                         sort_filter_t filter,
+                         struct list_head *removed)
+{
+    struct list_head *tail = head;
+    bool tail_dup = false; /* whether @tail equals a dropped node */
+
+    while (a || b) {
+        struct list_head *node;
+        /* if equal, take 'a' -- important for sort stability */
+        if (!b || (a && sort_cmp(priv, cmp, descend, a, b) <= 0)) {
+            node = a;
+            a = a->next;
+        } else {
+            node = b;
+            b = b->next;
+        }
+
+        switch (filter) {
+        case SORT_FILTER_DEDUP:
+            if (tail != head && !cmp(priv, tail, node)) {
+                list_add_tail(node, removed);
+                tail_dup = true;
+                continue;
+            }
+            if (tail_dup)
+                tail = drop_tail(tail, removed);
+            tail_dup = false;
+            break;
+        case SORT_FILTER_ASCEND:
+            while (tail != head && cmp(priv, tail, node) > 0)
+                tail = drop_tail(tail, removed);
+            break;
+        case SORT_FILTER_DESCEND:
+            while (tail != head && cmp(priv, tail, node) < 0)
+                tail = drop_tail(tail, removed);
+            break;
+        }
+        tail->next = node;
+        node->prev = tail;
+        tail = node;
+    }
+    if (tail_dup)
+        tail = drop_tail(tail, removed);
+
+    /* And the final links to make a circular doubly-linked list */
+    tail->next = head;
+    head->prev = tail;
+}
+
+/* Sort the nodes of @head into the two lists left for the final merge, or
+ * return false if there are fewer than two nodes */
+static bool sort_pending(void *priv,
+                         struct list_head *head,
+                         bool descend,
+                         list_cmp_func_t cmp,
+                         struct list_head **a,
+                         struct list_head **b)
 {
     struct list_head *list = head->next, *pending = NULL;
     size_t count = 0; /* Count of pending */
 
     if (list == head->prev) /* Zero or one elements */
-        return;
+        return false;
 
     /* Convert to a null-terminated singly-linked list. */
     head->prev->next = NULL;
@@ -114,7 +191,7 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
         if (likely(bits)) {
             struct list_head *a = *tail, *b = a->prev;
 
-            a = merge(priv, cmp, b, a);
+            a = merge(priv, cmp, descend, b, a);
             /* Install the merged result in place of the inputs */
             a->prev = b->prev;
             *tail = a;
@@ -136,9 +213,35 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
         if (!next)
             break;
-        list = merge(priv, cmp, pending, list);
+        list = merge(priv, cmp, descend, pending, list);
         pending = next;
     }
+    *a = pending;
+    *b = list;
+    return true;
+}
+
+void list_sort(void *priv,
+               struct list_head *head,
+               bool descend,
+               list_cmp_func_t cmp)
+{
+    struct list_head *a, *b;
+    if (!sort_pending(priv, head, descend, cmp, &a, &b))
+        return;
     /* The final merge, rebuilding prev links */
-    merge_final(priv, cmp, head, pending, list);
+    merge_final(priv, cmp, descend, head, a, b);
+}
+
+void list_sort_filter(void *priv,
+                      struct list_head *head,
+                      bool descend,
+                      list_cmp_func_t cmp,
+                      sort_filter_t filter,
+                      struct list_head *removed)
+{
+    struct list_head *a, *b;
+    if (!sort_pending(priv, head, descend, cmp, &a, &b))
+        return;
+    merge_filter(priv, cmp, descend, head, a, b, filter, removed);
 }
\ No newline at end of file
@@ -1,3 +1,6 @@
+#ifndef LAB0_LISTSORT_H
+#define LAB0_LISTSORT_H
+
 /**
  * The following `likely` and `unlikely` definition from <linux/compiler.h>
  * only requires the `__builtin_expect()` in gnu gcc.
@@ -13,4 +16,37 @@ typedef int (*list_cmp_func_t)(void *,
                                const struct list_head *,
                                const struct list_head *);
 
-void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
\ No newline at end of file
+/* Compare @a with @b in the order of the sort, the arguments are swapped in
+ * descending order so that equal nodes are still kept in their order */
+static inline int sort_cmp(void *priv,
+                           list_cmp_func_t cmp,
+                           bool descend,
+                           const struct list_head *a,
+                           const struct list_head *b)
+{
+    return descend ? cmp(priv, b, a) : cmp(priv, a, b);
+}
+
+void list_sort(void *priv,
+               struct list_head *head,
+               bool descend,
+               list_cmp_func_t cmp);
+
+/* What the final merge of list_sort_filter() keeps of the sorted nodes, like
+ * q_delete_dup(), q_ascend() and q_descend() applied to the sorted list */
+typedef enum {
+    SORT_FILTER_DEDUP,   /* the nodes equal to no other one */
+    SORT_FILTER_ASCEND,  /* the nodes not greater than any node after them */
+    SORT_FILTER_DESCEND, /* the nodes not less than any node after them */
+} sort_filter_t;
+
+/* Sort like list_sort(), and filter the nodes in the final merge at once. The
+ * nodes filtered out are moved to @removed. */
+void list_sort_filter(void *priv,
+                      struct list_head *head,
+                      bool descend,
+                      list_cmp_func_t cmp,
+                      sort_filter_t filter,
+                      struct list_head *removed);
+
+#endif /* LAB0_LISTSORT_H */
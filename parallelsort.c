@@ -0,0 +1,190 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "list.h"
+#include "listsort.h"
+#include "parallelsort.h"
+
+/* The lists shorter than this are not worth the cost of the threads */
+#define PARALLEL_MIN_NODES 4096
+
+int sort_threads = 4;
+
+/* The task of a thread, which is either sorting a segment of the list or
+ * merging two sorted segments into @list */
+struct segment {
+    struct list_head head; /* circular header to sort the segment */
+    struct list_head *list, *other;
+    int count; /* comparisons made by the thread */
+    void *priv;
+    bool descend;
+    list_cmp_func_t cmp;
+};
+
+static inline int segment_cmp(struct segment *seg,
+                              struct list_head *a,
+                              struct list_head *b)
+{
+    void *priv = seg->priv ? &seg->count : NULL;
+    return sort_cmp(priv, seg->cmp, seg->descend, a, b);
+}
+
+/* Sort the segment by list_sort() and leave a null-terminated list */
+static void *sort_segment(void *arg)
+{
+    struct segment *seg = arg;
+    list_sort(seg->priv ? &seg->count : NULL, &seg->head, seg->descend,
+              seg->cmp);
+    seg->head.prev->next = NULL;
+    seg->list = seg->head.next;
+    return NULL;
+}
+
+/* Merge @other into @list, the nodes of @list go first on ties */
+static void *merge_segment(void *arg)
+{
+    struct segment *seg = arg;
+    struct list_head *a = seg->list, *b = seg->other;
+    struct list_head *head = NULL, **tail = &head;
+
+    for (;;) {
+        /* if equal, take 'a' -- important for sort stability */
+        if (segment_cmp(seg, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    seg->list = head;
+    seg->other = NULL;
+    return NULL;
+}
+
+/* Run one task for each of @segs in their own threads, the task is run by the
+ * calling thread instead if a thread cannot be created */
+static void run_tasks(struct segment *segs,
+                      int n,
+                      int stride,
+                      void *(*task)(void *))
+{
+    pthread_t tids[MAX_SORT_THREADS];
+    bool created[MAX_SORT_THREADS];
+
+    /* The threads must not take SIGALRM, whose handler jumps back to the
+     * exception_setup() of the main thread, so they are created with it
+     * blocked. The main thread still takes it while it waits for them, and
+     * the time limit ends a sort which hangs. */
+    sigset_t alrm, old_mask;
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alrm, &old_mask);
+    for (int i = 0; i < n; i++)
+        created[i] = !pthread_create(&tids[i], NULL, task, &segs[i * stride]);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    for (int i = 0; i < n; i++) {
+        if (!created[i])
+            task(&segs[i * stride]);
+    }
+    for (int i = 0; i < n; i++) {
+        if (created[i])
+            pthread_join(tids[i], NULL);
+    }
+}
+
+void parallel_sort(void *priv,
+                   struct list_head *head,
+                   bool descend,
+                   list_cmp_func_t cmp)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    int threads = sort_threads;
+    if (threads > MAX_SORT_THREADS)
+        threads = MAX_SORT_THREADS;
+
+    size_t len = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        len++;
+
+    if (threads <= 1 || len < PARALLEL_MIN_NODES) {
+        list_sort(priv, head, descend, cmp);
+        return;
+    }
+
+    /* The segments are not on the stack, which the threads could otherwise
+     * still write to after the time limit jumps out of the sort. They are
+     * lost in that case. */
+    struct segment *segs = malloc(sizeof(struct segment) * threads);
+    if (!segs) {
+        list_sort(priv, head, descend, cmp);
+        return;
+    }
+
+    /* Cut the list into contiguous segments of about the same length */
+    struct list_head *list = head->next;
+    for (int i = 0; i < threads; i++) {
+        size_t seg_len = len / threads + ((size_t) i < len % threads);
+        struct segment *seg = &segs[i];
+        seg->count = 0;
+        seg->priv = priv;
+        seg->descend = descend;
+        seg->cmp = cmp;
+        seg->other = NULL;
+
+        seg->head.next = list;
+        list->prev = &seg->head;
+        while (--seg_len)
+            list = list->next;
+        struct list_head *next = list->next;
+        list->next = &seg->head;
+        seg->head.prev = list;
+        list = next;
+    }
+
+    run_tasks(segs, threads, 1, sort_segment);
+
+    /* Merge the segments pairwise in a tree, where the merges of each level
+     * run in parallel. The left one is always the earlier segment. */
+    for (int stride = 1; stride < threads; stride *= 2) {
+        int pairs = 0;
+        for (int i = 0; i + stride < threads; i += stride * 2) {
+            segs[i].other = segs[i + stride].list;
+            pairs++;
+        }
+        run_tasks(segs, pairs, stride * 2, merge_segment);
+    }
+
+    /* Rebuild prev links to make a circular doubly-linked list */
+    struct list_head *tail = head;
+    for (list = segs[0].list; list; list = list->next) {
+        tail->next = list;
+        list->prev = tail;
+        tail = list;
+    }
+    tail->next = head;
+    head->prev = tail;
+
+    if (priv) {
+        for (int i = 0; i < threads; i++)
+            *((int *) priv) += segs[i].count;
+    }
+    free(segs);
+}
@@ -0,0 +1,24 @@
+#include "listsort.h"
+
+/* The upper bound of the number of threads to sort a list */
+#define MAX_SORT_THREADS 64
+
+/* The number of threads parallel_sort() uses, set by the "threads" option */
+extern int sort_threads;
+
+/**
+ * parallel_sort() - Stable merge sort with multiple threads
+ * @priv: the counter of comparisons as an 'int *', or NULL
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ * @cmp: the comparison function
+ *
+ * The list is cut into one segment for each of @sort_threads threads, each
+ * sorted by list_sort(), and then the segments are merged pairwise by the
+ * threads. Each thread counts the comparisons on its own, which are added to
+ * @priv at the end. Short lists are sorted by list_sort() directly.
+ */
+void parallel_sort(void *priv,
+                   struct list_head *head,
+                   bool descend,
+                   list_cmp_func_t cmp);
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -24,6 +25,7 @@
 #include "listsort.h"
 #include "random.h"
 #include "sort_test.h"
+#include "sort_test_impl.h"
 #include "timsort.h"
 
 /* Shannon entropy */
@@ -56,7 +58,6 @@ extern int show_entropy;
 
 /* How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST_SIZE 30
 
@@ -104,9 +105,6 @@ static bool do_free(int argc, char *argv[])
     }
     error_check();
 
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     struct list_head *qnext = NULL;
     if (chain.size > 1) {
         qnext = (current->chain.next == &chain.head) ? chain.head.next
@@ -119,7 +117,6 @@ static bool do_free(int argc, char *argv[])
         if (exception_setup(true))
             q_free(current->q);
         exception_cancel();
-        set_cautious_mode(true);
     }
 
     if (current) {
@@ -176,7 +173,7 @@ static void fill_rand_string(char *buf, size_t buf_size)
         len = rand() % buf_size;
 
     uint64_t randstr_buf_64[MAX_RANDSTR_LEN] = {0};
-    randombytes((uint8_t *) randstr_buf_64, len * sizeof(uint64_t));
+    prng_fill((uint8_t *) randstr_buf_64, len * sizeof(uint64_t));
     for (size_t n = 0; n < len; n++)
         buf[n] = charset[randstr_buf_64[n] % (sizeof(charset) - 1)];
 
@@ -287,6 +284,79 @@ static void fill_cont_full_string(char *buf,
 }
 
 /* insertion */
+/* The strings inserted at once by queue_insert_bulk() */
+#define INSERT_BATCH 1024
+
+/* Insert @inserts, or a random string if @need_rand, @reps times in batches.
+ * Each element is checked to hold a copy of its own, like the insertions one
+ * by one. */
+static bool queue_insert_bulk(position_t pos,
+                              char *inserts,
+                              int reps,
+                              bool need_rand)
+{
+    static char randstrs[INSERT_BATCH][MAX_RANDSTR_LEN];
+    char *strings[INSERT_BATCH];
+    bool ok = true;
+
+    for (int r = 0; ok && r < reps;) {
+        int n = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+        for (int i = 0; i < n; i++) {
+            if (need_rand)
+                fill_rand_string(randstrs[i], sizeof(randstrs[i]));
+            strings[i] = need_rand ? randstrs[i] : inserts;
+        }
+
+        int cnt = pos == POS_TAIL ? q_insert_tail_bulk(current->q, strings, n)
+                                  : q_insert_head_bulk(current->q, strings, n);
+        current->size += cnt;
+
+        /* The last string inserted is the nearest one to the end */
+        struct list_head *node = pos == POS_TAIL ? current->q->prev
+                                                 : current->q->next;
+        const char *lasts = NULL;
+        for (int i = cnt - 1; i >= 0 && node != current->q; i--) {
+            element_t *entry = list_entry(node, element_t, list);
+            char *cur_inserts = q_value(entry);
+            if (!cur_inserts) {
+                report(1, "ERROR: Failed to save copy of string in queue");
+                ok = false;
+                break;
+            } else if (cur_inserts == strings[i]) {
+                report(1,
+                       "ERROR: Need to allocate and copy string for new "
+                       "queue element");
+                ok = false;
+                break;
+            } else if (cur_inserts == lasts && !entry->interned) {
+                report(1,
+                       "ERROR: Need to allocate separate string for each "
+                       "queue element");
+                ok = false;
+                break;
+            }
+            lasts = cur_inserts;
+            node = pos == POS_TAIL ? node->prev : node->next;
+        }
+        r += cnt;
+
+        if (cnt < n) {
+            /* The next insertion failed, go on after it */
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %s failed", strings[cnt]);
+            else {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       strings[cnt], fail_count);
+                ok = false;
+            }
+            r++;
+        }
+        ok = ok && !error_check();
+    }
+    return ok;
+}
+
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
     if (simulation) {
@@ -386,8 +456,12 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    /* A string repeated or random strings are inserted in batches */
+    bool bulk = reps > 1 && (need_rand || inserts == argv[1]);
     if (current && exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
+        if (bulk)
+            ok = queue_insert_bulk(pos, inserts, reps, need_rand);
+        for (int r = 0; ok && !bulk && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
             else if (need_worse)
@@ -428,7 +502,7 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                     pos == POS_TAIL
                         ? list_last_entry(current->q, element_t, list)
                         : list_first_entry(current->q, element_t, list);
-                char *cur_inserts = entry->value;
+                char *cur_inserts = q_value(entry);
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
@@ -438,7 +512,8 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 1 && lasts == cur_inserts &&
+                           !entry->interned) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
@@ -485,41 +560,112 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     return ok;
 }
 
+/* The default sweep of stest, doubling the number of nodes */
 #define MIN_NODE 4
 #define MAX_NODE 16384  // 2^14
+#define N_REPEATS 15    /* measurements for each number of nodes */
 
-static inline bool do_stest(int argc, char *argv[])
+/* Parse the sweep of the number of nodes in the form of "min[:max[:step]]",
+ * where the step prefixed with 'x' multiplies the number instead */
+static bool parse_sweep(char *arg, sort_bench_t *bench)
 {
-    bool ok = true;
-
-    for (int nums = MIN_NODE; nums <= MAX_NODE && ok; nums++) {
-        if (nums % 1024 == 0)
-            printf("Finish %.2f percent\n", ((double) nums / MAX_NODE) * 100);
-        for (int i = 0; i < 6 && ok; i++) {
-            ok = sort_test(i, nums);
+    char *end;
+    long min = strtol(arg, &end, 10), max = min, step = 1;
+    bool geometric = false;
+    if (end != arg && *end == ':') {
+        arg = end + 1;
+        max = strtol(arg, &end, 10);
+        if (end != arg && *end == ':') {
+            arg = end + 1;
+            geometric = (*arg == 'x');
+            arg += geometric;
+            step = strtol(arg, &end, 10);
         }
     }
-    return ok;
+    if (end == arg || *end || min > INT_MAX || max > INT_MAX ||
+        step > INT_MAX)
+        return false;
+
+    bench->min_nodes = min;
+    bench->max_nodes = max;
+    bench->step = step;
+    bench->geometric = geometric;
+    return true;
 }
 
-/* the shuffle algorithm introduced by Fisher–Yates */
-static void shuffle(struct list_head *head)
+static bool do_stest(int argc, char *argv[])
 {
-    int len = q_size(head);
-    struct list_head *pos, *safe;
-    /* similar as `list_for_each_entry_safe` in Linux Kernel List Management API
-     */
-    for (pos = head->next, safe = pos->next; pos != head && len;
-         pos = safe, safe = safe->next, len--) {
-        struct list_head *j = head->next;
-        /* randomly choose a number between 0~(len - 1) */
-        for (int r = rand() % len; r;
-             r--) /* the seed `srand` had been defined in qtest*/
-            j = j->next;
-        if (pos == j)
+    sort_bench_t bench = {
+        .engines = NULL,
+        .distributions = NULL,
+        .min_nodes = MIN_NODE,
+        .max_nodes = MAX_NODE,
+        .step = 2,
+        .geometric = true,
+        .repeats = N_REPEATS,
+        .descend = descend,
+        .json = false,
+        .output = stdout,
+    };
+    char *file_name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        char *opt = argv[i];
+        if (!strcmp(opt, "-l")) {
+            sort_test_list();
+            return true;
+        }
+        if (!strcmp(opt, "-j")) {
+            bench.json = true;
             continue;
-        list_swap(pos, j); /* from Linux Kernel List Management API */
+        }
+        if (i + 1 == argc || opt[0] != '-' || !opt[1] || opt[2]) {
+            report(1, "Invalid option '%s' for stest", opt);
+            return false;
+        }
+
+        char *arg = argv[++i];
+        switch (opt[1]) {
+        case 'e':
+            bench.engines = arg;
+            break;
+        case 'd':
+            bench.distributions = arg;
+            break;
+        case 'n':
+            if (!parse_sweep(arg, &bench)) {
+                report(1, "Invalid number of nodes '%s'", arg);
+                return false;
+            }
+            break;
+        case 'r':
+            if (!get_int(arg, &bench.repeats) || bench.repeats < 1) {
+                report(1, "Invalid number of repetitions '%s'", arg);
+                return false;
+            }
+            break;
+        case 'o':
+            file_name = arg;
+            break;
+        default:
+            report(1, "Invalid option '%s' for stest", opt);
+            return false;
+        }
+    }
+
+    if (file_name && strcmp(file_name, "-")) {
+        bench.output = fopen(file_name, "w");
+        if (!bench.output) {
+            report(1, "Unable to open output file '%s'", file_name);
+            return false;
+        }
     }
+
+    bool ok = sort_test(&bench);
+
+    if (bench.output != stdout)
+        fclose(bench.output);
+    return ok;
 }
 
 /* shuffle the elements in queue linked-list */
@@ -693,10 +839,26 @@ static inline bool do_rt(int argc, char *argv[])
     return queue_remove(POS_TAIL, argc, argv);
 }
 
+static int cmp_string(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Whether @s occurs more than once in the sorted array @strings of @n */
+static bool is_dup_string(char **strings, size_t n, char *s)
+{
+    char **p = bsearch(&s, strings, n, sizeof(char *), cmp_string);
+    size_t i = p - strings;
+    return (i > 0 && !strcmp(strings[i - 1], s)) ||
+           (i + 1 < n && !strcmp(strings[i + 1], s));
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    /* With -u, the queue is not required to be sorted */
+    bool unsorted = argc == 2 && !strcmp(argv[1], "-u");
+    if (argc != 1 && !unsorted) {
+        report(1, "%s takes no arguments but -u", argv[0]);
         return false;
     }
 
@@ -716,19 +878,19 @@ static bool do_dedup(int argc, char *argv[])
             if (!tmp)
                 break;
             INIT_LIST_HEAD(&tmp->list);
-            slen = strlen(item->value) + 1;
+            slen = strlen(q_value(item)) + 1;
             tmp->value = malloc(slen);
             if (!tmp->value) {
                 free(tmp);
                 break;
             }
-            memcpy(tmp->value, item->value, slen);
+            memcpy(tmp->value, q_value(item), slen);
             list_add_tail(&tmp->list, &l_copy);
         }
         // Return false if the loop does not leave properly
         if (&item->list != current->q) {
             list_for_each_entry_safe (item, tmp, &l_copy, list) {
-                free(item->value);
+                free(q_value(item));
                 free(item);
             }
             report(1,
@@ -738,16 +900,42 @@ static bool do_dedup(int argc, char *argv[])
         }
     }
 
+    /* The strings of an unsorted queue are sorted on the side to tell the
+     * duplicate ones */
+    char **strings = NULL;
+    size_t n = 0;
+    if (unsorted) {
+        list_for_each_entry (item, &l_copy, list)
+            n++;
+        strings = malloc(sizeof(char *) * (n ? n : 1));
+        if (!strings) {
+            list_for_each_entry_safe (item, tmp, &l_copy, list) {
+                free(q_value(item));
+                free(item);
+            }
+            report(1,
+                   "INTERNAL ERROR.  Could not allocate space for "
+                   "duplicate checking");
+            return false;
+        }
+        n = 0;
+        list_for_each_entry (item, &l_copy, list)
+            strings[n++] = q_value(item);
+        qsort(strings, n, sizeof(char *), cmp_string);
+    }
+
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_dup(current->q);
+        ok = unsorted ? q_delete_dup_unsorted(current->q)
+                      : q_delete_dup(current->q);
     exception_cancel();
 
     if (!ok) {
         list_for_each_entry_safe (item, tmp, &l_copy, list) {
-            free(item->value);
+            free(q_value(item));
             free(item);
         }
+        free(strings);
         report(1, "ERROR: Calling delete duplicate on null queue");
         return false;
     }
@@ -758,19 +946,21 @@ static bool do_dedup(int argc, char *argv[])
     list_for_each_entry (item, &l_copy, list) {
         // Skip comparison with new list if the string is duplicate
         bool is_next_dup =
-            item->list.next != &l_copy &&
-            strcmp(list_entry(item->list.next, element_t, list)->value,
-                   item->value) == 0;
+            unsorted ? is_dup_string(strings, n, q_value(item))
+                     : item->list.next != &l_copy &&
+                           strcmp(q_value(list_entry(item->list.next,
+                                                     element_t, list)),
+                                  q_value(item)) == 0;
         if (is_this_dup || is_next_dup) {
             // Update list size
             current->size--;
         } else if (l_tmp != current->q &&
-                   strcmp(list_entry(l_tmp, element_t, list)->value,
-                          item->value) == 0)
+                   strcmp(q_value(list_entry(l_tmp, element_t, list)),
+                          q_value(item)) == 0)
             l_tmp = l_tmp->next;
         else
             ok = false;
-        is_this_dup = is_next_dup;
+        is_this_dup = !unsorted && is_next_dup;
     }
     // All elements in new list should be traversed
     ok = ok && l_tmp == current->q;
@@ -780,9 +970,10 @@ static bool do_dedup(int argc, char *argv[])
                "not in queue");
 
     list_for_each_entry_safe (item, tmp, &l_copy, list) {
-        free(item->value);
+        free(q_value(item));
         free(item);
     }
+    free(strings);
 
     q_show(3);
     return ok && !error_check();
@@ -884,6 +1075,8 @@ bool do_tsort(int argc, char *argv[])
             q_timsort_old(&count, current->q, descend);
         else if (!strcmp(name, "binary"))
             q_timsort_binary(&count, current->q, descend);
+        else if (!strcmp(name, "gallop"))
+            q_timsort_gallop(&count, current->q, descend);
         else {
             report(1, "%s invalid sort name for Tim sort", argv[0]);
             return false;
@@ -900,13 +1093,13 @@ bool do_tsort(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
             }
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1, "ERROR: Not sorted in descending order");
                 ok = false;
                 break;
@@ -920,14 +1113,13 @@ bool do_tsort(int argc, char *argv[])
     return ok && !error_check();
 }
 
-/* make the interpreter could apply lib/list_sort */
-bool do_ksort(int argc, char *argv[])
-{
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
-        return false;
-    }
+/* A sort of the queue which counts the comparisons in @priv */
+typedef void (*queue_sort_t)(void *priv, struct list_head *head, bool descend);
 
+/* Sort the current queue by @sort, and check that it is in the order of the
+ * 'descend' option */
+static bool sort_check(queue_sort_t sort)
+{
     int cnt = 0;
     if (!current || !current->q)
         report(3, "Warning: Calling sort on null queue");
@@ -942,10 +1134,8 @@ bool do_ksort(int argc, char *argv[])
     int count = 0;
 
     set_noallocate_mode(true);
-    if (current && exception_setup(true)) {
-        printf("==== Testing listsort ====\n");
-        q_list_sort(&count, current->q, descend);
-    }
+    if (current && exception_setup(true))
+        sort(&count, current->q, descend);
     exception_cancel();
     set_noallocate_mode(false);
 
@@ -957,13 +1147,13 @@ bool do_ksort(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
             }
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1, "ERROR: Not sorted in descending order");
                 ok = false;
                 break;
@@ -977,6 +1167,182 @@ bool do_ksort(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* make the interpreter could apply lib/list_sort */
+bool do_ksort(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    printf("==== Testing listsort ====\n");
+    return sort_check(q_list_sort);
+}
+
+/* make the interpreter could apply the MSD radix sort */
+bool do_rsort(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    return sort_check(q_radix_sort);
+}
+
+/* make the interpreter could apply the parallel merge sort */
+bool do_psort(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    return sort_check(q_parallel_sort);
+}
+
+static int cmp_string_descend(const void *a, const void *b)
+{
+    return cmp_string(b, a);
+}
+
+/* Filter the sorted array @strings of @n in place like @filter, and return
+ * the number of the strings kept */
+static size_t filter_strings(char **strings, size_t n, sort_filter_t filter)
+{
+    size_t m = 0;
+    const char *prev = NULL;
+    for (size_t i = 0; i < n; i++) {
+        char *s = strings[i];
+        switch (filter) {
+        case SORT_FILTER_DEDUP: {
+            bool dup = (prev && !strcmp(prev, s)) ||
+                       (i + 1 < n && !strcmp(strings[i + 1], s));
+            prev = s;
+            if (!dup)
+                strings[m++] = s;
+            break;
+        }
+        case SORT_FILTER_ASCEND:
+            while (m && strcmp(strings[m - 1], s) > 0)
+                m--;
+            strings[m++] = s;
+            break;
+        case SORT_FILTER_DESCEND:
+            while (m && strcmp(strings[m - 1], s) < 0)
+                m--;
+            strings[m++] = s;
+            break;
+        }
+    }
+    return m;
+}
+
+/* Sort the queue and filter it at once, and compare it with a copy of its
+ * strings sorted and then filtered on the side */
+static bool sort_filter_check(int argc, char *argv[], sort_filter_t filter)
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    int cnt = 0;
+    if (!current || !current->q)
+        report(3, "Warning: Calling sort on null queue");
+    else
+        cnt = q_size(current->q);
+    error_check();
+
+    if (cnt < 2)
+        report(3, "Warning: Calling sort on single node");
+    error_check();
+
+    if (!current || !current->q)
+        return !error_check();
+
+    size_t n = 0, total = 0;
+    element_t *entry;
+    list_for_each_entry (entry, current->q, list) {
+        n++;
+        total += strlen(q_value(entry)) + 1;
+    }
+    char **expect = malloc(sizeof(char *) * (n ? n : 1));
+    char *buf = malloc(total ? total : 1);
+    if (!expect || !buf) {
+        free(expect);
+        free(buf);
+        report(1, "INTERNAL ERROR.  Could not allocate space for checking");
+        return false;
+    }
+    char *p = buf;
+    n = 0;
+    list_for_each_entry (entry, current->q, list) {
+        size_t len = strlen(q_value(entry)) + 1;
+        memcpy(p, q_value(entry), len);
+        expect[n++] = p;
+        p += len;
+    }
+    qsort(expect, n, sizeof(char *),
+          descend ? cmp_string_descend : cmp_string);
+    size_t m = filter_strings(expect, n, filter);
+
+    if (exception_setup(true)) {
+        switch (filter) {
+        case SORT_FILTER_DEDUP:
+            current->size = q_sort_dedup(current->q, descend);
+            break;
+        case SORT_FILTER_ASCEND:
+            current->size = q_sort_ascend(current->q, descend);
+            break;
+        case SORT_FILTER_DESCEND:
+            current->size = q_sort_descend(current->q, descend);
+            break;
+        }
+    }
+    exception_cancel();
+
+    bool ok = current->size == (int) m;
+    size_t i = 0;
+    list_for_each_entry (entry, current->q, list) {
+        if (!ok || i == m || strcmp(q_value(entry), expect[i])) {
+            ok = false;
+            break;
+        }
+        i++;
+    }
+    if (!ok || i != m) {
+        report(1,
+               "ERROR: The queue is not the same as being sorted and then "
+               "filtered by %s",
+               filter == SORT_FILTER_DEDUP    ? "dedup"
+               : filter == SORT_FILTER_ASCEND ? "ascend"
+                                              : "descend");
+        ok = false;
+    }
+
+    free(expect);
+    free(buf);
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_sortdedup(int argc, char *argv[])
+{
+    return sort_filter_check(argc, argv, SORT_FILTER_DEDUP);
+}
+
+static bool do_sortascend(int argc, char *argv[])
+{
+    return sort_filter_check(argc, argv, SORT_FILTER_ASCEND);
+}
+
+static bool do_sortdescend(int argc, char *argv[])
+{
+    return sort_filter_check(argc, argv, SORT_FILTER_DESCEND);
+}
+
 bool do_sort(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1026,20 +1392,20 @@ bool do_sort(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
             }
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1, "ERROR: Not sorted in descending order");
                 ok = false;
                 break;
             }
             /* Ensure the stability of the sort */
             if (current->size <= MAX_NODES &&
-                !strcmp(item->value, next_item->value)) {
+                !strcmp(q_value(item), q_value(next_item))) {
                 bool unstable = false;
                 for (unsigned i = 0; i < MAX_NODES; i++) {
                     if (nodes[i] == cur_l->next) {
@@ -1055,7 +1421,7 @@ bool do_sort(int argc, char *argv[])
                         1,
                         "ERROR: Not stable sort. The duplicate strings \"%s\" "
                         "are not in the same order.",
-                        item->value);
+                        q_value(item));
                     ok = false;
                     break;
                 }
@@ -1153,7 +1519,7 @@ static bool do_ascend(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (strcmp(item->value, next_item->value) > 0) {
+            if (strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
                 ok = false;
@@ -1200,7 +1566,7 @@ static bool do_descend(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (strcmp(item->value, next_item->value) < 0) {
+            if (strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(1,
                        "ERROR: At least one node violated the ordering rule");
                 ok = false;
@@ -1263,7 +1629,7 @@ static bool do_merge(int argc, char *argv[])
     exception_cancel();
     set_noallocate_mode(false);
 
-    if (q_size(&chain.head) > 1) {
+    if (chain.size > 1) {
         chain.size = 1;
         current = list_entry(chain.head.next, queue_contex_t, chain);
         current->size = len;
@@ -1288,7 +1654,7 @@ static bool do_merge(int argc, char *argv[])
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
             next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
+            if (!descend && strcmp(q_value(item), q_value(next_item)) > 0) {
                 report(1,
                        "ERROR: Not sorted in ascending order (It might because "
                        "of unsorted queues are merged or there're some flaws "
@@ -1298,7 +1664,7 @@ static bool do_merge(int argc, char *argv[])
             }
 
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
+            if (descend && strcmp(q_value(item), q_value(next_item)) < 0) {
                 report(
                     1,
                     "ERROR: Not sorted in descending order (It might because "
@@ -1364,11 +1730,11 @@ static bool q_show(int vlevel)
         while (ok && ori != cur && cnt < current->size) {
             element_t *e = list_entry(cur, element_t, list);
             if (cnt < BIG_LIST_SIZE) {
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
+                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", q_value(e));
                 if (show_entropy == 1) {
                     report_noreturn(
                         vlevel, "(%3.2f%%)",
-                        shannon_entropy((const uint8_t *) e->value));
+                        shannon_entropy((const uint8_t *) q_value(e)));
                 }
             }
             cnt++;
@@ -1485,12 +1851,36 @@ static void console_init()
                 "Sort queue in ascending/descening order by `lib/list_sort` in "
                 "Linux kernel",
                 "");
-    ADD_COMMAND(tsort, "Sort queue in ascending/descening order by timsort",
+    ADD_COMMAND(rsort,
+                "Sort queue in ascending/descening order by MSD radix sort",
+                "");
+    ADD_COMMAND(psort,
+                "Sort queue in ascending/descening order by merge sort with "
+                "multiple threads",
+                "");
+    ADD_COMMAND(sortdedup,
+                "Sort queue and delete all nodes that have duplicate string "
+                "in the final merge of `lib/list_sort`",
                 "");
+    ADD_COMMAND(sortascend,
+                "Sort queue and remove the nodes like ascend in the final "
+                "merge of `lib/list_sort`",
+                "");
+    ADD_COMMAND(sortdescend,
+                "Sort queue and remove the nodes like descend in the final "
+                "merge of `lib/list_sort`",
+                "");
+    ADD_COMMAND(tsort,
+                "Sort queue in ascending/descening order by timsort. Choose "
+                "the variant by name (linear, old, binary or gallop)",
+                "[name]");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
     ADD_COMMAND(dm, "Delete middle node in queue", "");
-    ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
+    ADD_COMMAND(dedup,
+                "Delete all nodes that have duplicate string, -u if the queue "
+                "is not sorted",
+                "[-u]");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
     ADD_COMMAND(ascend,
@@ -1508,17 +1898,29 @@ static void console_init()
                 "shuffle technique.",
                 "");
     ADD_COMMAND(stest,
-                "Conduct a sorting test using the provided data distribution "
-                "on the sorting algorithms in this program.",
-                "");
+                "Measure the sorting algorithms on the data distributions "
+                "over a sweep of nodes in the order of 'descend', -l lists "
+                "the names",
+                "[-e algos] [-d dists] [-n min[:max[:[x]step]]] [-r reps] "
+                "[-j] [-o file]");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("workers", &dudect_workers,
+              "Number of threads measuring in simulation mode", NULL);
+    add_param("cache", &cache_limit,
+              "Number of freed blocks of each size kept for reuse outside "
+              "cautious mode",
+              NULL);
+    add_param("threads", &sort_threads,
+              "Number of threads for the parallel sort (psort)", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("intern", &q_intern_strings,
+              "Share the equal strings of the elements through a pool", NULL);
 }
 
 /* Signal handlers */
@@ -1551,9 +1953,6 @@ static void q_init()
 static bool q_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
         while (chain.size > 0) {
@@ -1566,7 +1965,6 @@ static bool q_quit(int argc, char *argv[])
     }
 
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -1580,9 +1978,10 @@ static bool q_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f IFILE][-v VLEVEL][-l LFILE]\n", cmd);
+    printf("Usage: %s [-h] [-f IFILE][-F IFILE][-v VLEVEL][-l LFILE]\n", cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f IFILE   Read commands from IFILE\n");
+    printf("\t-F IFILE   Run commands from IFILE in batch, without echo\n");
     printf("\t-v VLEVEL  Set verbosity level\n");
     printf("\t-l LFILE   Echo results to LFILE\n");
     exit(0);
@@ -1650,16 +2049,20 @@ int main(int argc, char *argv[])
     /* To hold input file name */
     char buf[BUFSIZE];
     char *infile_name = NULL;
+    bool batch = false;
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:F:l:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
             break;
+        case 'F':
+            batch = true;
+            /* fall through */
         case 'f':
             strncpy(buf, optarg, BUFSIZE);
             buf[BUFSIZE - 1] = '\0';
@@ -1691,6 +2094,7 @@ int main(int argc, char *argv[])
      * with the Unix time.
      */
     srand(os_random(getpid() ^ getppid()));
+    prng_seed(os_random(getpid() ^ getppid()));
 
     q_init();
     init_cmd();
@@ -1714,7 +2118,7 @@ int main(int argc, char *argv[])
     add_quit_helper(q_quit);
 
     bool ok = true;
-    ok = ok && run_console(infile_name);
+    ok = ok && (batch ? run_batch(infile_name) : run_console(infile_name));
 
     /* Do finish_cmd() before check whether ok is true or false */
     ok = finish_cmd() && ok;
@@ -1,3 +1,5 @@
+#include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,15 +13,331 @@
  *   cppcheck-suppress nullPointer
  */
 
+/* Get the queue header which carries the cached size of the queue */
+static inline queue_head_t *queue_of(struct list_head *head)
+{
+    return container_of(head, queue_head_t, head);
+}
+
+/* The capacity of the chunks in bytes. A queue starts with a small chunk and
+ * doubles the capacity of each new one, so that short queues stay small and
+ * long queues need only a few allocations. */
+#define CHUNK_MIN 1024
+#define CHUNK_MAX 65536
+
+/* The largest chunk reserved at once for the elements of a bulk insertion */
+#define CHUNK_BULK_MAX (16 << 20)
+
+/* The alignment of the elements carved from a chunk */
+#define CHUNK_ALIGN(x) (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/**
+ * struct q_chunk - A block of memory the elements and their strings are carved
+ * from one after another
+ * @live: the number of the elements carved from the chunk and not released
+ * @used: the number of the bytes carved from @data
+ * @capacity: the size of @data in bytes
+ * @retired: whether the owner queue no longer carves elements from the chunk
+ * @data: the memory to carve the elements from, aligned like CHUNK_ALIGN()
+ *
+ * The chunk is allocated as a single block by malloc(), so it is still tracked
+ * by the allocation accounting of the harness.
+ */
+struct q_chunk {
+    size_t live;
+    size_t used;
+    size_t capacity;
+    bool retired;
+    char data[] __attribute__((aligned(sizeof(void *))));
+};
+
+/**
+ * struct q_istr - A string shared through the string pool
+ * @next: the next string in the same bucket
+ * @refs: the number of the copies taken
+ * @hash: the hash of @s
+ * @s: the string
+ */
+struct q_istr {
+    struct q_istr *next;
+    size_t refs;
+    uint32_t hash;
+    char s[];
+};
+
+/* The string pool, a hash table whose buckets are chained. It is freed once
+ * it is empty, so that an idle pool holds no memory. */
+static struct {
+    struct q_istr **buckets;
+    size_t size; /* a power of 2 */
+    size_t count;
+} pool;
+
+/* The dudect workers insert into their queues at the same time */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define POOL_MIN 64
+
+int q_intern_strings = 0;
+
+/* FNV-1a hash of a string, whose length is stored in @lenp */
+static uint32_t str_hash(const char *s, size_t *lenp)
+{
+    uint32_t hash = 2166136261u;
+    const char *p = s;
+    while (*p) {
+        hash ^= (unsigned char) *p++;
+        hash *= 16777619u;
+    }
+    *lenp = p - s;
+    return hash;
+}
+
+/* Double the buckets of the pool, return false if there is no memory */
+static bool pool_grow(void)
+{
+    size_t size = pool.size ? pool.size * 2 : POOL_MIN;
+    struct q_istr **buckets = calloc(size, sizeof(*buckets));
+    if (!buckets)
+        return false;
+    for (size_t i = 0; i < pool.size; i++) {
+        struct q_istr *str = pool.buckets[i], *next;
+        for (; str; str = next) {
+            next = str->next;
+            str->next = buckets[str->hash & (size - 1)];
+            buckets[str->hash & (size - 1)] = str;
+        }
+    }
+    free(pool.buckets);
+    pool.buckets = buckets;
+    pool.size = size;
+    return true;
+}
+
+/* Free the buckets of the pool if it is empty */
+static void pool_shrink(void)
+{
+    if (pool.count)
+        return;
+    free(pool.buckets);
+    pool.buckets = NULL;
+    pool.size = 0;
+}
+
+static char *pool_get(const char *s)
+{
+    size_t len;
+    uint32_t hash = str_hash(s, &len);
+    if (pool.size) {
+        struct q_istr *str = pool.buckets[hash & (pool.size - 1)];
+        for (; str; str = str->next) {
+            if (str->hash == hash && !strcmp(str->s, s)) {
+                str->refs++;
+                return str->s;
+            }
+        }
+    }
+
+    if (pool.count >= pool.size && !pool_grow() && !pool.size)
+        return NULL;
+    struct q_istr *str = malloc(sizeof(struct q_istr) + len + 1);
+    if (!str) {
+        pool_shrink();
+        return NULL;
+    }
+    str->refs = 1;
+    str->hash = hash;
+    memcpy(str->s, s, len + 1);
+    str->next = pool.buckets[hash & (pool.size - 1)];
+    pool.buckets[hash & (pool.size - 1)] = str;
+    pool.count++;
+    return str->s;
+}
+
+static void pool_put(char *s)
+{
+    struct q_istr *str =
+        (struct q_istr *) (s - offsetof(struct q_istr, s));
+    if (--str->refs)
+        return;
+
+    struct q_istr **link = &pool.buckets[str->hash & (pool.size - 1)];
+    while (*link != str)
+        link = &(*link)->next;
+    *link = str->next;
+    free(str);
+    pool.count--;
+    pool_shrink();
+}
+
+/* Get the shared copy of a string from the pool */
+char *q_str_intern(const char *s)
+{
+    pthread_mutex_lock(&pool_lock);
+    char *ret = pool_get(s);
+    pthread_mutex_unlock(&pool_lock);
+    return ret;
+}
+
+/* Give back a shared copy to the pool */
+void q_str_release(char *s)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_put(s);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static struct q_chunk *chunk_new(size_t capacity)
+{
+    struct q_chunk *chunk =
+        (struct q_chunk *) malloc(sizeof(struct q_chunk) + capacity);
+    if (!chunk)
+        return NULL;
+    chunk->live = 0;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->retired = false;
+    return chunk;
+}
+
+/* The owner queue gives up the chunk, which is freed if no element uses it */
+static void chunk_retire(struct q_chunk *chunk)
+{
+    if (!chunk)
+        return;
+    if (!chunk->live)
+        free(chunk);
+    else
+        chunk->retired = true;
+}
+
+/* Create an element holding a copy of @s, which is carved from the current
+ * chunk of @q if possible */
+static element_t *new_element(queue_head_t *q, const char *s)
+{
+    size_t s_len = strlen(s) + 1;
+    // a short string is held by the element itself, and a long one is shared
+    // through the pool if the strings are interned
+    bool interned = q_intern_strings && s_len > Q_INLINE_LEN;
+    size_t need = sizeof(element_t) +
+                  (s_len > Q_INLINE_LEN && !interned ? CHUNK_ALIGN(s_len) : 0);
+    element_t *new;
+
+    if (need > CHUNK_MAX / 2) {
+        // too long to be carved from a chunk, allocate it on its own
+        new = (element_t *) malloc(sizeof(element_t));
+        if (!new)
+            return NULL;  // no memory space for `new`
+        new->value = (char *) malloc(s_len * sizeof(char));
+        if (!new->value) {
+            free(new);
+            return NULL;  // no memory space for `new->value`
+        }
+        new->chunk = NULL;
+        new->interned = false;
+        memcpy(new->value, s, s_len);
+        new->key = q_key_prefix(s);
+        return new;
+    }
+
+    char *shared = interned ? q_str_intern(s) : NULL;
+    if (interned && !shared)
+        return NULL;  // no memory space for the pool
+
+    struct q_chunk *chunk = q->chunk;
+    if (chunk && !chunk->live)
+        chunk->used = 0;  // every element in it is released, reuse it
+    if (!chunk || chunk->capacity - chunk->used < need) {
+        size_t capacity = chunk ? chunk->capacity * 2 : CHUNK_MIN;
+        while (capacity < need)
+            capacity *= 2;  // room for a long string at least
+        if (capacity > CHUNK_MAX)
+            capacity = CHUNK_MAX;
+        chunk = chunk_new(capacity);
+        if (!chunk) {
+            if (shared)
+                q_str_release(shared);
+            return NULL;  // no memory space for a new chunk
+        }
+        chunk_retire(q->chunk);
+        q->chunk = chunk;
+    }
+
+    new = (element_t *) (chunk->data + chunk->used);
+    new->interned = interned;
+    new->chunk = chunk;
+    if (interned) {
+        new->value = shared;
+    } else {
+        new->value = s_len > Q_INLINE_LEN ? (char *) (new + 1) : NULL;
+        memcpy(q_value(new), s, s_len);
+    }
+    new->key = q_key_prefix(s);
+    chunk->used += need;
+    chunk->live++;
+    return new;
+}
+
+/* The bytes of a chunk taken by the element holding @s */
+static inline size_t element_need(const char *s)
+{
+    size_t s_len = strlen(s) + 1;
+    if (s_len <= Q_INLINE_LEN || q_intern_strings)
+        return sizeof(element_t);
+    return sizeof(element_t) + CHUNK_ALIGN(s_len);
+}
+
+/* Make room for @need more bytes in the current chunk of @q with a single
+ * allocation, so that a bulk insertion does not grow the chunks step by step.
+ * The elements which do not fit are left to new_element(). */
+static void chunk_reserve(queue_head_t *q, size_t need)
+{
+    struct q_chunk *chunk = q->chunk;
+    if (chunk && !chunk->live)
+        chunk->used = 0;
+    if (chunk && chunk->capacity - chunk->used >= need)
+        return;
+    if (need <= CHUNK_MAX)
+        return;  // the usual growth of the chunks takes it just as well
+    if (need > CHUNK_BULK_MAX)
+        need = CHUNK_BULK_MAX;
+
+    chunk = chunk_new(need);
+    if (!chunk)
+        return;
+    chunk_retire(q->chunk);
+    q->chunk = chunk;
+}
+
+/* Release the element */
+void q_release_element(element_t *e)
+{
+    struct q_chunk *chunk = e->chunk;
+    if (e->interned)
+        q_str_release(e->value);
+    if (!chunk) {
+        if (!e->interned)
+            free(e->value);
+        free(e);
+        return;
+    }
+    if (!--chunk->live && chunk->retired)
+        free(chunk);
+}
 
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    struct list_head *head =
-        (struct list_head *) malloc(sizeof(struct list_head));
-    if (head)
-        INIT_LIST_HEAD(head);
-    return head;
+    queue_head_t *q = (queue_head_t *) malloc(sizeof(queue_head_t));
+    if (!q)
+        return NULL;
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    // have the first chunk ready, so that inserting into an empty queue takes
+    // no longer than into any other. It is allocated on the first insertion
+    // instead if there is no memory for it now.
+    q->chunk = chunk_new(CHUNK_MIN);
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -32,7 +350,10 @@ void q_free(struct list_head *head)
             list_del(&iterator->list);
             q_release_element(iterator);
         }
-        free(head);
+        // the chunk goes away with the last element carved from it, which
+        // may have been moved to another queue
+        chunk_retire(queue_of(head)->chunk);
+        free(queue_of(head));
     }
 }
 
@@ -41,17 +362,11 @@ bool q_insert_head(struct list_head *head, char *s)
 {
     if (!head || !s)
         return false;  // the first node of inserted list_head is NULL
-    element_t *new = (element_t *) malloc(sizeof(element_t));
+    element_t *new = new_element(queue_of(head), s);
     if (!new)
-        return false;  // no memory space for `new`
-    int s_len = strlen(s) + 1;
-    new->value = (char *) malloc(s_len * sizeof(char));
-    if (!new->value) {
-        free(new);
-        return false;  // no memory space for `new->value`
-    }
-    memcpy(new->value, s, s_len);  // insert value
+        return false;
     list_add(&new->list, head);
+    queue_of(head)->size++;
     return true;
 }
 
@@ -60,20 +375,65 @@ bool q_insert_tail(struct list_head *head, char *s)
 {
     if (!head || !s)
         return false;  // the first node of inserted list_head is NULL
-    element_t *new = (element_t *) malloc(sizeof(element_t));
+    element_t *new = new_element(queue_of(head), s);
     if (!new)
-        return false;  // no memory space for `new`
-    int s_len = strlen(s) + 1;
-    new->value = (char *) malloc(s_len * sizeof(char));
-    if (!new->value) {
-        free(new);
-        return false;  // no memory space for `new->value`
-    }
-    memcpy(new->value, s, s_len);  // insert value
+        return false;
     list_add_tail(&new->list, head);
+    queue_of(head)->size++;
     return true;
 }
 
+/* Build the elements of @strings as a chain, in the order they would be after
+ * inserting them one by one at the head if @head_first, or at the tail
+ * otherwise. Return the number of the elements built. */
+static int build_chain(queue_head_t *q,
+                       struct list_head *chain,
+                       char *strings[],
+                       int n,
+                       bool head_first)
+{
+    size_t need = 0;
+    for (int i = 0; i < n; i++)
+        need += element_need(strings[i]);
+    chunk_reserve(q, need);
+
+    int cnt = 0;
+    for (; cnt < n; cnt++) {
+        element_t *new = new_element(q, strings[cnt]);
+        if (!new)
+            break;
+        if (head_first)
+            list_add(&new->list, chain);
+        else
+            list_add_tail(&new->list, chain);
+    }
+    return cnt;
+}
+
+/* Insert the elements of @strings at head of queue, the last one first */
+int q_insert_head_bulk(struct list_head *head, char *strings[], int n)
+{
+    if (!head || !strings)
+        return 0;
+    LIST_HEAD(chain);
+    int cnt = build_chain(queue_of(head), &chain, strings, n, true);
+    list_splice(&chain, head);
+    queue_of(head)->size += cnt;
+    return cnt;
+}
+
+/* Insert the elements of @strings at tail of queue */
+int q_insert_tail_bulk(struct list_head *head, char *strings[], int n)
+{
+    if (!head || !strings)
+        return 0;
+    LIST_HEAD(chain);
+    int cnt = build_chain(queue_of(head), &chain, strings, n, false);
+    list_splice_tail(&chain, head);
+    queue_of(head)->size += cnt;
+    return cnt;
+}
+
 /* Remove an element from head of queue */
 element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
 {
@@ -81,11 +441,12 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
         return NULL;  // `head` is NULL, or there's no list in `head`
     element_t *remove = list_first_entry(head, element_t, list);
     list_del(&remove->list);
+    queue_of(head)->size--;
     if (sp) {
-        size_t q = bufsize > strlen(remove->value) + 1
-                       ? strlen(remove->value) + 1
+        size_t q = bufsize > strlen(q_value(remove)) + 1
+                       ? strlen(q_value(remove)) + 1
                        : bufsize;
-        memcpy(sp, remove->value, q);
+        memcpy(sp, q_value(remove), q);
         sp[bufsize - 1] = '\0';
     }
     return remove;
@@ -98,11 +459,12 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
         return NULL;  // `head` is NULL, or there's no list in `head`
     element_t *remove = list_last_entry(head, element_t, list);
     list_del(&remove->list);
+    queue_of(head)->size--;
     if (sp) {
-        size_t q = bufsize > strlen(remove->value) + 1
-                       ? strlen(remove->value) + 1
+        size_t q = bufsize > strlen(q_value(remove)) + 1
+                       ? strlen(q_value(remove)) + 1
                        : bufsize;
-        memcpy(sp, remove->value, q);
+        memcpy(sp, q_value(remove), q);
         sp[bufsize - 1] = '\0';
     }
     return remove;
@@ -111,13 +473,16 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
 /* Return number of elements in queue */
 int q_size(struct list_head *head)
 {
-    if (!head || list_empty(head))
+    if (!head)
         return 0;
+#ifdef QSIZE_CHECK
     int size = 0;
     struct list_head *p;
     list_for_each (p, head)
         size++;
-    return size;
+    assert(size == queue_of(head)->size);
+#endif
+    return queue_of(head)->size;
 }
 
 /* Delete the middle node in queue */
@@ -134,6 +499,7 @@ bool q_delete_mid(struct list_head *head)
         ;
     list_del(foreward);
     q_release_element(container_of(foreward, element_t, list));
+    queue_of(head)->size--;
     return true;
 }
 
@@ -144,21 +510,118 @@ bool q_delete_dup(struct list_head *head)
     if (!head || list_empty(head))
         return false;  // `head` is NULL, or there's no list in `head`
     element_t *iterator, *next;
+    int removed = 0;
     /*note that the list is sorted*/
     list_for_each_entry_safe (iterator, next, head, list) {
-        if (&next->list != head && !strcmp(iterator->value, next->value)) {
+        if (&next->list != head && !q_value_cmp(iterator, next)) {
             do {
                 element_t *next_to_safe =
                     list_entry(next->list.next, element_t, list);
                 list_del(&next->list);
                 q_release_element(next);
+                removed++;
                 next = next_to_safe;
-            } while (&next->list != head &&
-                     !strcmp(iterator->value, next->value));
+            } while (&next->list != head && !q_value_cmp(iterator, next));
             list_del(&iterator->list);
             q_release_element(iterator);
+            removed++;
         }
     }
+    queue_of(head)->size -= removed;
+    return true;
+}
+
+/**
+ * struct dup_slot - A distinct string seen by q_delete_dup_unsorted()
+ * @first: the element holding its first occurrence, NULL if the slot is free
+ * @hash: the hash of the string
+ * @dup: whether the string occurs more than once
+ */
+struct dup_slot {
+    element_t *first;
+    uint32_t hash;
+    bool dup;
+};
+
+static int value_cmp(void *priv,
+                     const struct list_head *a,
+                     const struct list_head *b)
+{
+    return q_value_cmp(list_entry(a, element_t, list),
+                       list_entry(b, element_t, list));
+}
+
+static int seq_cmp(void *priv,
+                   const struct list_head *a,
+                   const struct list_head *b)
+{
+    int x = list_entry(a, element_t, list)->seq;
+    int y = list_entry(b, element_t, list)->seq;
+    return (x > y) - (x < y);
+}
+
+/* Delete the duplicate strings by sorting the queue, and put the distinct
+ * ones back in their order by the positions recorded in @seq. It takes no
+ * memory, for when there is none for the hash table. */
+static void delete_dup_by_sort(struct list_head *head)
+{
+    int seq = 0;
+    element_t *e;
+    list_for_each_entry (e, head, list)
+        e->seq = seq++;
+    list_sort(NULL, head, false, value_cmp);
+    q_delete_dup(head);
+    list_sort(NULL, head, false, seq_cmp);
+}
+
+/* Delete all nodes that have duplicate string in unsorted queue */
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return false;  // `head` is NULL, or there's no list in `head`
+
+    // the table is kept at most half full
+    size_t size = 1;
+    while (size < 2 * (size_t) queue_of(head)->size)
+        size <<= 1;
+    struct dup_slot *table =
+        is_noallocate_mode() ? NULL : calloc(size, sizeof(struct dup_slot));
+    if (!table) {
+        delete_dup_by_sort(head);
+        return true;
+    }
+
+    // a later occurrence is deleted at once, and the first one is marked
+    int removed = 0;
+    element_t *iterator, *next;
+    list_for_each_entry_safe (iterator, next, head, list) {
+        size_t len;
+        uint32_t hash = str_hash(q_value(iterator), &len);
+        size_t i = hash & (size - 1);
+        for (; table[i].first; i = (i + 1) & (size - 1)) {
+            if (table[i].hash == hash && !q_value_cmp(table[i].first, iterator))
+                break;
+        }
+        if (!table[i].first) {
+            table[i].first = iterator;
+            table[i].hash = hash;
+            continue;
+        }
+        table[i].dup = true;
+        list_del(&iterator->list);
+        q_release_element(iterator);
+        removed++;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        if (table[i].dup) {
+            list_del(&table[i].first->list);
+            q_release_element(table[i].first);
+            removed++;
+        }
+    }
+    free(table);
+    queue_of(head)->size -= removed;
     return true;
 }
 
@@ -214,7 +677,7 @@ int q_cmp(void *priv, const struct list_head *a, const struct list_head *b)
     element_t *element_a = list_entry(a, element_t, list);
     element_t *element_b = list_entry(b, element_t, list);
 
-    int res = strcmp(element_a->value, element_b->value);
+    int res = q_value_cmp(element_a, element_b);
 
     if (!res)
         return 0;
@@ -250,34 +713,48 @@ struct list_head *merge_two_list(void *priv,
     return head;
 }
 
-/* Doing the list seperation for merge sort (divide and conquer) */
-struct list_head *divide(void *priv,
-                         struct list_head *head,
-                         struct list_head *end,
-                         bool descend,
-                         list_cmp_func_t cmp)
+/* The number of pending lists in the bottom-up merge sort, pending list i
+ * holds 2^i nodes, which is enough for any list indexed by size_t */
+#define MERGE_LEVELS (sizeof(size_t) * 8)
+
+/* Bottom-up merge sort on a null-terminated singly-linked list */
+static struct list_head *merge_sort(void *priv,
+                                    struct list_head *list,
+                                    bool descend,
+                                    list_cmp_func_t cmp)
 {
-    if (head == end)
-        return head;
-    // find middle point
-    struct list_head *foreward = head, *backward = end;
-    for (; foreward != backward && foreward->next != backward;
-         foreward = foreward->next, backward = backward->prev)
-        ;
-    if (foreward == backward)
-        backward = backward->next;
-    // make the list no longer be circular
-    foreward->next = NULL;
-    backward->prev = NULL;
-    // keep divide until hit the break point
-    struct list_head *left = divide(priv, head, foreward, descend, cmp);
-    struct list_head *right = divide(priv, backward, end, descend, cmp);
-    // conquer the partitions
-    return merge_two_list(priv, left, right, descend, cmp);
+    /* pending[i] is either NULL or a sorted list of 2^i nodes, which always
+     * comes earlier in the input than those of pending[i - 1] */
+    struct list_head *pending[MERGE_LEVELS] = {NULL};
+    size_t levels = 0;
+    while (list) {
+        // take one node off the input as a sorted list of length 1
+        struct list_head *carry = list;
+        list = list->next;
+        carry->next = NULL;
+        // merge it with the pending lists of the same length, like a carry
+        // propagating in a binary counter
+        size_t i;
+        for (i = 0; pending[i]; i++) {
+            carry = merge_two_list(priv, pending[i], carry, descend, cmp);
+            pending[i] = NULL;
+        }
+        pending[i] = carry;
+        if (i >= levels)
+            levels = i + 1;
+    }
+    // merge together all the pending lists, the earlier list is on the left
+    struct list_head *result = NULL;
+    for (size_t i = 0; i < levels; i++)
+        result = merge_two_list(priv, pending[i], result, descend, cmp);
+    return result;
 }
 
 /* Sorting function for external program to call */
-void sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+void sort(void *priv,
+          struct list_head *head,
+          bool descend,
+          list_cmp_func_t cmp)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;  // `head` is NULL, no list in `head`, or one element
@@ -285,7 +762,7 @@ void sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
     // make the list no longer be circular
     end->next = NULL;
     head->next->prev = NULL;
-    head->next = divide(priv, head->next, end, 0, cmp);
+    head->next = merge_sort(priv, head->next, descend, cmp);
     // make the list to be circular again (move the head back)
     struct list_head *curr;
     for (curr = head; curr->next; curr = curr->next)
@@ -304,7 +781,7 @@ void q_sort(struct list_head *head, bool descend)
     // make the list no longer be circular
     end->next = NULL;
     head->next->prev = NULL;
-    head->next = divide(NULL, head->next, end, descend, q_cmp);
+    head->next = merge_sort(NULL, head->next, descend, q_cmp);
     // make the list to be circular again (move the head back)
     struct list_head *curr;
     for (curr = head; curr->next; curr = curr->next)
@@ -318,9 +795,7 @@ void q_list_sort(void *priv, struct list_head *head, bool descend)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;  // `head` is NULL, no list in `head`, or one element
-    list_sort(priv, head, q_cmp);
-    if (descend)
-        q_reverse(head);
+    list_sort(priv, head, descend, q_cmp);
 }
 
 /* Sort elements of queue in ascending/descending order by Tim sort */
@@ -328,9 +803,7 @@ void q_timsort_old(void *priv, struct list_head *head, bool descend)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;
-    timsort_old(priv, head, q_cmp);
-    if (descend)
-        q_reverse(head);
+    timsort_old(priv, head, descend, q_cmp);
 }
 
 /* Sort elements of queue in ascending/descending order by Tim sort with minrun
@@ -339,9 +812,7 @@ void q_timsort(void *priv, struct list_head *head, bool descend)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;
-    timsort(priv, head, q_cmp);
-    if (descend)
-        q_reverse(head);
+    timsort(priv, head, descend, q_cmp);
 }
 
 /* Sort elements of queue in ascending/descending order by Tim sort with minrun
@@ -350,9 +821,33 @@ void q_timsort_binary(void *priv, struct list_head *head, bool descend)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;
-    timsort_binary(priv, head, q_cmp);
-    if (descend)
-        q_reverse(head);
+    timsort_binary(priv, head, descend, q_cmp);
+}
+
+/* Sort elements of queue in ascending/descending order by Tim sort with
+ * galloping mode during merging */
+void q_timsort_gallop(void *priv, struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+    timsort_gallop(priv, head, descend, q_cmp);
+}
+
+/* Sort elements of queue in ascending/descending order by MSD radix sort */
+void q_radix_sort(void *priv, struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+    radix_sort(priv, head, descend, q_cmp);
+}
+
+/* Sort elements of queue in ascending/descending order by merge sort with
+ * multiple threads */
+void q_parallel_sort(void *priv, struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+    parallel_sort(priv, head, descend, q_cmp);
 }
 
 /* Remove every node which has a node with a strictly less value anywhere to
@@ -369,9 +864,10 @@ int q_ascend(struct list_head *head)
     element_t *p, *c_max = list_entry(curr, element_t, list);
     for (; c_max->list.prev != head;) {
         p = list_entry(c_max->list.next, element_t, list);
-        if (strcmp(p->value, c_max->value) < 0) {
+        if (strcmp(q_value(p), q_value(c_max)) < 0) {
             list_del(&p->list);
             q_release_element(p);
+            queue_of(head)->size--;
         } else
             c_max = p;
     }
@@ -392,9 +888,10 @@ int q_descend(struct list_head *head)
     element_t *p, *c_max = list_entry(curr, element_t, list);
     for (; c_max->list.prev != head;) {
         p = list_entry(c_max->list.prev, element_t, list);
-        if (strcmp(p->value, c_max->value) < 0) {
+        if (strcmp(q_value(p), q_value(c_max)) < 0) {
             list_del(&p->list);
             q_release_element(p);
+            queue_of(head)->size--;
         } else
             c_max = p;
     }
@@ -412,15 +909,102 @@ int q_merge(struct list_head *head, bool descend)
         return list_entry(head->next, queue_contex_t, chain)->size;
     // merging by 'q_context_t' structure
     queue_contex_t *main_q = list_entry(head->next, queue_contex_t, chain);
-    // 分段合併
-    for (struct list_head *curr = head->next->next; curr != head;
-         curr = curr->next) {
-        queue_contex_t *c = list_entry(curr, queue_contex_t, chain);
-        list_splice_init(c->q, main_q->q);
-        main_q->size += c->size;
-        c->size = 0;
+    int total = 0;
+    /* Every queue is already sorted, so each of them is treated as a run and
+     * pushed onto the pending stack of `list_sort`. Runs are merged as soon as
+     * two of them cover the same number of queues, which merges k queues with
+     * O(N log k) comparisons. The `prev` pointer of the first node of a run
+     * links the stack, and a merge always takes the earlier queue as the left
+     * list to keep the merge stable.
+     */
+    struct list_head *pending = NULL;
+    size_t count = 0; /* Count of runs pushed onto the stack */
+    queue_contex_t *c;
+    list_for_each_entry (c, head, chain) {
+        total += queue_of(c->q)->size;
+        queue_of(c->q)->size = 0;
+        if (c != main_q) {
+            main_q->size += c->size;
+            c->size = 0;
+        }
+        if (list_empty(c->q))
+            continue;
+
+        struct list_head *run = c->q->next;
+        // make the queue a null-terminated singly-linked list
+        c->q->prev->next = NULL;
+        INIT_LIST_HEAD(c->q);
+
+        size_t bits;
+        struct list_head **tail = &pending;
+        /* Find the least-significant clear bit in count */
+        for (bits = count; bits & 1; bits >>= 1)
+            tail = &(*tail)->prev;
+        /* Do the indicated merge */
+        if (bits) {
+            struct list_head *a = *tail, *b = a->prev;
+            a = merge_two_list(NULL, b, a, descend, q_cmp);
+            /* Install the merged result in place of the inputs */
+            a->prev = b->prev;
+            *tail = a;
+        }
+        run->prev = pending;
+        pending = run;
+        count++;
     }
-    // sorting
-    q_sort(main_q->q, descend);
+    if (!pending)
+        return main_q->size;
+
+    // merge together all the pending runs, the earlier run is on the left
+    struct list_head *list = pending;
+    for (pending = pending->prev; pending; pending = pending->prev)
+        list = merge_two_list(NULL, pending, list, descend, q_cmp);
+
+    // make the list to be circular again (move the head back)
+    struct list_head *curr;
+    main_q->q->next = list;
+    for (curr = main_q->q; curr->next; curr = curr->next)
+        curr->next->prev = curr;
+    curr->next = main_q->q;
+    curr->next->prev = curr;
+    queue_of(main_q->q)->size = total;
     return main_q->size;
 }
+
+/* Sort the queue by `list_sort.c`, filtering the elements in its final merge,
+ * and release the elements filtered out */
+static int sort_filter(struct list_head *head,
+                       bool descend,
+                       sort_filter_t filter)
+{
+    if (!head)
+        return 0;
+    LIST_HEAD(removed);
+    list_sort_filter(NULL, head, descend, q_cmp, filter, &removed);
+    element_t *iterator, *next;
+    list_for_each_entry_safe (iterator, next, &removed, list) {
+        q_release_element(iterator);
+        queue_of(head)->size--;
+    }
+    return queue_of(head)->size;
+}
+
+/* Sort the queue and delete all nodes that have duplicate string */
+int q_sort_dedup(struct list_head *head, bool descend)
+{
+    return sort_filter(head, descend, SORT_FILTER_DEDUP);
+}
+
+/* Sort the queue and remove every node which has a node with a strictly less
+ * value anywhere to the right side of it */
+int q_sort_ascend(struct list_head *head, bool descend)
+{
+    return sort_filter(head, descend, SORT_FILTER_ASCEND);
+}
+
+/* Sort the queue and remove every node which has a node with a strictly
+ * greater value anywhere to the right side of it */
+int q_sort_descend(struct list_head *head, bool descend)
+{
+    return sort_filter(head, descend, SORT_FILTER_DESCEND);
+}
@@ -9,25 +9,144 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "harness.h"
 #include "list.h"
 #include "listsort.h"
+#include "parallelsort.h"
+#include "radixsort.h"
 #include "timsort.h"
 
+struct q_chunk;
+
+/* The size of the storage for short strings inside element_t, which covers
+ * the random strings generated by qtest */
+#define Q_INLINE_LEN 16
+
 /**
  * element_t - Linked list element
- * @value: pointer to array holding string
+ * @value: pointer to array holding string, or NULL if it is in @inline_value
  * @list: node of a doubly-linked list
- *
- * @value needs to be explicitly allocated and freed
+ * @key: the first 8 bytes of the string made by q_key_prefix()
+ * @interned: whether @value is shared with the other elements of the same
+ * string by q_str_intern()
+ * @chunk: the chunk the element and @value are carved from, or NULL
+ * @inline_value: the string of less than Q_INLINE_LEN characters
+ *
+ * If @chunk is NULL, the element and @value need to be explicitly allocated
+ * and freed. Otherwise both of them live in @chunk, which is freed as a whole
+ * once all of its elements are released. An interned @value lives in the
+ * string pool instead, and is only given back to it.
+ *
+ * The string should be read by q_value() rather than @value.
  */
 typedef struct {
     char *value;
     struct list_head list;
+    uint64_t key;
     int seq;
+    bool interned;
+    struct q_chunk *chunk;
+    char inline_value[Q_INLINE_LEN];
 } element_t;
 
+/**
+ * q_value() - Get the string held by the element
+ * @e: the element
+ *
+ * A short string is stored in the element itself, which saves a load of the
+ * pointer and a cache miss on another memory block.
+ *
+ * Return: the string held by @e
+ */
+static inline char *q_value(element_t *e)
+{
+    return e->value ? e->value : e->inline_value;
+}
+
+/**
+ * q_key_prefix() - Pack the first 8 bytes of a string into an integer
+ * @s: the string
+ *
+ * The bytes are packed in big-endian order and padded with zeros, hence
+ * comparing two keys as integers orders the strings the same as strcmp().
+ *
+ * Return: the key of @s
+ */
+static inline uint64_t q_key_prefix(const char *s)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key <<= 8;
+        if (*s)
+            key |= (unsigned char) *s++;
+    }
+    return key;
+}
+
+/**
+ * q_value_cmp() - Compare the strings held by two elements
+ * @a: the first element
+ * @b: the second element
+ *
+ * The strings are compared by @key first, and by strcmp() on the remaining
+ * characters only if both keys are the same and full of 8 characters, and the
+ * elements do not share the same interned string.
+ *
+ * Return: negative, zero or positive like strcmp()
+ */
+static inline int q_value_cmp(element_t *a, element_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    if (!(a->key & 0xff))
+        return 0;  // both strings end within the key
+    if (a->value && a->value == b->value)
+        return 0;  // the same interned string
+    return strcmp(q_value(a) + 8, q_value(b) + 8);
+}
+
+/* Whether the strings of new elements are interned, see q_str_intern() */
+extern int q_intern_strings;
+
+/**
+ * q_str_intern() - Get the copy of a string shared through the string pool
+ * @s: the string
+ *
+ * The pool keeps one reference counted copy of each string, so the elements
+ * holding equal strings share the same memory, and compare equal by their
+ * pointers. Each copy taken must be given back by q_str_release().
+ *
+ * Return: the shared copy of @s, or NULL for allocation failed
+ */
+char *q_str_intern(const char *s);
+
+/**
+ * q_str_release() - Give back a copy taken by q_str_intern()
+ * @s: the shared copy
+ *
+ * The copy is freed once all of its references are given back.
+ */
+void q_str_release(char *s);
+
+/**
+ * queue_head_t - The header of a queue
+ * @head: head of the circular doubly-linked list holding the elements
+ * @size: the number of elements linked to @head
+ * @chunk: the chunk new elements are carved from, or NULL
+ *
+ * q_new() hands out the address of @head, so the queue API keeps taking a
+ * plain 'struct list_head *'. Every operation that links or unlinks an element
+ * maintains @size, which makes q_size() a constant time operation.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    struct q_chunk *chunk;
+} queue_head_t;
+
 /**
  * queue_contex_t - The context managing a chain of queues
  * @q: pointer to the head of the queue
@@ -81,6 +200,37 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_bulk() - Insert many elements in the head at once
+ * @head: header of queue
+ * @strings: the strings would be inserted
+ * @n: the number of @strings
+ *
+ * The queue ends up as if each of @strings were inserted by q_insert_head() in
+ * turn, so the last one is at the head. The elements are built as a chain,
+ * whose storage is allocated in as few blocks as possible, and the chain is
+ * spliced into the queue.
+ *
+ * Return: the number of the elements inserted, which are the first ones of
+ * @strings if an allocation failed
+ */
+int q_insert_head_bulk(struct list_head *head, char *strings[], int n);
+
+/**
+ * q_insert_tail_bulk() - Insert many elements at the tail at once
+ * @head: header of queue
+ * @strings: the strings would be inserted
+ * @n: the number of @strings
+ *
+ * The queue ends up as if each of @strings were inserted by q_insert_tail() in
+ * turn. The elements are built as a chain, whose storage is allocated in as
+ * few blocks as possible, and the chain is spliced into the queue.
+ *
+ * Return: the number of the elements inserted, which are the first ones of
+ * @strings if an allocation failed
+ */
+int q_insert_tail_bulk(struct list_head *head, char *strings[], int n);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -115,18 +265,22 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
  * q_release_element() - Release the element
  * @e: element would be released
  *
+ * An element carved from a chunk only drops its reference to the chunk, and
+ * the chunk is freed by the last of them once its queue is freed. The element
+ * may outlive its queue, or be moved to another queue before releasing.
+ *
  * This function is intended for internal use only.
  */
-static inline void q_release_element(element_t *e)
-{
-    test_free(e->value);
-    test_free(e);
-}
+void q_release_element(element_t *e);
 
 /**
  * q_size() - Get the size of the queue
  * @head: header of queue
  *
+ * The size is read from the enclosing queue_head_t, hence @head must be created
+ * by q_new(). Building with QSIZE_CHECK defined verifies the cached size
+ * against a walk over the whole list on every call.
+ *
  * Return: the number of elements in queue, zero if queue is NULL or empty
  */
 int q_size(struct list_head *head);
@@ -158,6 +312,20 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/**
+ * q_delete_dup_unsorted() - Delete all nodes that have duplicate string in a
+ *                           queue of any order
+ * @head: header of queue
+ *
+ * Like q_delete_dup(), but the queue needs not be sorted, and the distinct
+ * strings stay in their order. It takes a single pass with a transient hash
+ * table of the strings. If the table cannot be allocated, the queue is sorted
+ * and put back in order instead, which needs no memory.
+ *
+ * Return: true for success, false if list is NULL or empty.
+ */
+bool q_delete_dup_unsorted(struct list_head *head);
+
 /**
  * q_swap() - Swap every two adjacent nodes
  * @head: header of queue
@@ -197,12 +365,16 @@ void q_reverseK(struct list_head *head, int k);
  * sort() - Sorting function for external program to call
  * @priv: the argument for the comparison function
  * @head: header of queue
+ * @descend: whether or not to sort in descending order
  * @cmp: the comparison function
  *
  * No effect if queue is NULL or empty. If there has only one element, do
  * nothing.
  */
-void sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
+void sort(void *priv,
+          struct list_head *head,
+          bool descend,
+          list_cmp_func_t cmp);
 
 /**
  * q_sort() - Sort elements of queue in ascending/descending order
@@ -262,6 +434,42 @@ void q_timsort(void *priv, struct list_head *head, bool descend);
  */
 void q_timsort_binary(void *priv, struct list_head *head, bool descend);
 
+/**
+ * q_timsort_gallop() - Sort elements of queue in ascending/descending order by
+ * Tim sort with galloping mode during merging
+ * @priv: the argument for the comparison function
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ *
+ * No effect if queue is NULL or empty. If there has only one element, do
+ * nothing.
+ */
+void q_timsort_gallop(void *priv, struct list_head *head, bool descend);
+
+/**
+ * q_radix_sort() - Sort elements of queue in ascending/descending order by MSD
+ * radix sort
+ * @priv: the argument for the comparison function
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ *
+ * No effect if queue is NULL or empty. If there has only one element, do
+ * nothing.
+ */
+void q_radix_sort(void *priv, struct list_head *head, bool descend);
+
+/**
+ * q_parallel_sort() - Sort elements of queue in ascending/descending order by
+ * merge sort with multiple threads
+ * @priv: the argument for the comparison function
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ *
+ * No effect if queue is NULL or empty. If there has only one element, do
+ * nothing.
+ */
+void q_parallel_sort(void *priv, struct list_head *head, bool descend);
+
 /**
  * q_ascend() - Remove every node which has a node with a strictly less
  * value anywhere to the right side of it.
@@ -314,4 +522,43 @@ int q_descend(struct list_head *head);
  */
 int q_merge(struct list_head *head, bool descend);
 
+/**
+ * q_sort_dedup() - Sort the queue and delete all nodes that have duplicate
+ * string at once
+ * @head: header of queue
+ * @descend: whether to sort in descending order
+ *
+ * The result is the same as q_list_sort() followed by q_delete_dup(), but the
+ * duplicates are deleted in the final merge of the sort, which saves a pass
+ * over the queue.
+ *
+ * Return: the number of elements in queue after performing operation
+ */
+int q_sort_dedup(struct list_head *head, bool descend);
+
+/**
+ * q_sort_ascend() - Sort the queue and remove the nodes like q_ascend() at once
+ * @head: header of queue
+ * @descend: whether to sort in descending order
+ *
+ * The result is the same as q_list_sort() followed by q_ascend(), but the
+ * nodes are removed in the final merge of the sort.
+ *
+ * Return: the number of elements in queue after performing operation
+ */
+int q_sort_ascend(struct list_head *head, bool descend);
+
+/**
+ * q_sort_descend() - Sort the queue and remove the nodes like q_descend() at
+ * once
+ * @head: header of queue
+ * @descend: whether to sort in descending order
+ *
+ * The result is the same as q_list_sort() followed by q_descend(), but the
+ * nodes are removed in the final merge of the sort.
+ *
+ * Return: the number of elements in queue after performing operation
+ */
+int q_sort_descend(struct list_head *head, bool descend);
+
 #endif /* LAB0_QUEUE_H */
@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+#include "queue.h"
+#include "radixsort.h"
+
+/* One bucket for each value of a byte, where bucket 0 holds the strings which
+ * end before the byte */
+#define RADIX_BUCKETS 256
+
+/* The buckets with no more nodes than this are sorted by insertion sort */
+#define RADIX_INSERTION_SIZE 16
+
+/* Get the byte of the string at @depth, which is read from the key prefix if
+ * possible to avoid loading the string itself */
+static inline unsigned char radix_byte(struct list_head *node, size_t depth)
+{
+    element_t *e = list_entry(node, element_t, list);
+    if (depth < 8)
+        return (unsigned char) (e->key >> (56 - depth * 8));
+    return (unsigned char) q_value(e)[depth];
+}
+
+/* Stable insertion sort on a null-terminated singly-linked list, the last node
+ * is stored in @last */
+static struct list_head *insertion_sort(void *priv,
+                                        list_cmp_func_t cmp,
+                                        bool descend,
+                                        struct list_head *list,
+                                        struct list_head **last)
+{
+    struct list_head *head = NULL, *tail = NULL;
+    while (list) {
+        struct list_head *node = list;
+        list = list->next;
+
+        if (!tail || sort_cmp(priv, cmp, descend, tail, node) <= 0) {
+            // the common case of the sorted input, append it
+            node->next = NULL;
+            if (tail)
+                tail->next = node;
+            else
+                head = node;
+            tail = node;
+            continue;
+        }
+
+        // insert it after the last node not greater than it
+        struct list_head **pos = &head;
+        while (sort_cmp(priv, cmp, descend, *pos, node) <= 0)
+            pos = &(*pos)->next;
+        node->next = *pos;
+        *pos = node;
+    }
+    *last = tail;
+    return head;
+}
+
+/* MSD radix sort on a null-terminated singly-linked list whose strings share
+ * the first @depth bytes, the last node is stored in @last */
+static struct list_head *msd_sort(void *priv,
+                                  list_cmp_func_t cmp,
+                                  bool descend,
+                                  struct list_head *list,
+                                  size_t depth,
+                                  struct list_head **last)
+{
+    for (;; depth++) {
+        size_t len = 0;
+        for (struct list_head *p = list; p && len <= RADIX_INSERTION_SIZE;
+             p = p->next)
+            len++;
+        if (len <= RADIX_INSERTION_SIZE)
+            return insertion_sort(priv, cmp, descend, list, last);
+
+        /* Distribute the nodes into the buckets by relinking them, which
+         * keeps the order of the nodes in each bucket */
+        struct list_head *heads[RADIX_BUCKETS] = {NULL};
+        struct list_head **tails[RADIX_BUCKETS];
+        size_t used = 0;
+        int byte = 0;
+        while (list) {
+            struct list_head *node = list;
+            list = list->next;
+            byte = radix_byte(node, depth);
+            if (!heads[byte]) {
+                tails[byte] = &heads[byte];
+                used++;
+            }
+            *tails[byte] = node;
+            tails[byte] = &node->next;
+        }
+
+        if (used == 1) {
+            *tails[byte] = NULL;
+            if (!byte) {
+                // every string ends here, they are all equal
+                *last = container_of(tails[byte], struct list_head, next);
+                return heads[byte];
+            }
+            // share one more byte, go on without another level of recursion
+            list = heads[byte];
+            continue;
+        }
+
+        /* Sort each bucket and concatenate them in order */
+        struct list_head *head = NULL, *tail = NULL;
+        for (int i = 0; i < RADIX_BUCKETS; i++) {
+            int b = descend ? RADIX_BUCKETS - 1 - i : i;
+            if (!heads[b])
+                continue;
+            *tails[b] = NULL;
+
+            struct list_head *sorted, *sorted_last;
+            if (!b) {
+                // the strings end here, which are equal and kept in order
+                sorted = heads[b];
+                sorted_last = container_of(tails[b], struct list_head, next);
+            } else {
+                sorted = msd_sort(priv, cmp, descend, heads[b], depth + 1,
+                                  &sorted_last);
+            }
+
+            if (tail)
+                tail->next = sorted;
+            else
+                head = sorted;
+            tail = sorted_last;
+        }
+        *last = tail;
+        return head;
+    }
+}
+
+void radix_sort(void *priv,
+                struct list_head *head,
+                bool descend,
+                list_cmp_func_t cmp)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    /* Convert to a null-terminated singly-linked list. */
+    head->prev->next = NULL;
+
+    struct list_head *last;
+    struct list_head *list =
+        msd_sort(priv, cmp, descend, head->next, 0, &last);
+
+    /* Rebuild prev links to make a circular doubly-linked list */
+    struct list_head *tail = head;
+    for (; list; list = list->next) {
+        tail->next = list;
+        list->prev = tail;
+        tail = list;
+    }
+    tail->next = head;
+    head->prev = tail;
+}
@@ -0,0 +1,17 @@
+#include "listsort.h"
+
+/**
+ * radix_sort() - Stable MSD radix sort for the queues of element_t
+ * @priv: the argument for the comparison function
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ * @cmp: the comparison function, only used to sort the small buckets
+ *
+ * The nodes are distributed into the buckets of each byte of the strings by
+ * relinking, and the buckets of no more than 16 nodes are sorted by insertion
+ * sort.
+ */
+void radix_sort(void *priv,
+                struct list_head *head,
+                bool descend,
+                list_cmp_func_t cmp);
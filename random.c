@@ -30,6 +30,8 @@
 
 #include "random.h"
 
+#include <string.h>
+
 #if defined(__linux__) || defined(__GNU__)
 /* We would need to include <linux/random.h>, but not every target has access
  * to the linux headers. We only need RNDGETENTCNT, so we instead inline it.
@@ -293,3 +295,63 @@ int randombytes(uint8_t *buf, size_t n)
 #error "randombytes(...) is not supported on this platform"
 #endif
 }
+
+/* The state of xoshiro256**, by David Blackman and Sebastiano Vigna, see:
+ * <https://prng.di.unimi.it/xoshiro256starstar.c>. It must not be all zeros,
+ * and starts from a fixed seed until prng_seed() is called. Each thread has
+ * a state of its own, so that the dudect workers drawing for the test
+ * allocator neither race with nor disturb the sequence of the main thread.
+ */
+static __thread uint64_t prng_state[4] = {
+    0x9e3779b97f4a7c15ULL,
+    0xbf58476d1ce4e5b9ULL,
+    0x94d049bb133111ebULL,
+    0x2545f4914f6cdd1dULL,
+};
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/* Expand the seed into the state by splitmix64 as the authors recommend */
+void prng_seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        prng_state[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t prng_next(void)
+{
+    uint64_t *s = prng_state;
+    const uint64_t result = rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+/* Fill @buf with @len random bytes, 8 bytes from each output */
+void prng_fill(uint8_t *buf, size_t len)
+{
+    while (len >= sizeof(uint64_t)) {
+        uint64_t r = prng_next();
+        memcpy(buf, &r, sizeof(r));
+        buf += sizeof(r);
+        len -= sizeof(r);
+    }
+    if (len) {
+        uint64_t r = prng_next();
+        memcpy(buf, &r, len);
+    }
+}
@@ -6,6 +6,15 @@
 
 extern int randombytes(uint8_t *buf, size_t len);
 
+/* A fast generator in user space (xoshiro256**), for the test data which has
+ * no need of randombytes() and the cost of its system calls. It is not
+ * suitable for cryptography. The state is per thread, and prng_seed() seeds
+ * the calling thread only.
+ */
+void prng_seed(uint64_t seed);
+uint64_t prng_next(void);
+void prng_fill(uint8_t *buf, size_t len);
+
 static inline uint8_t randombit(void)
 {
     uint8_t ret = 0;
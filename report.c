@@ -119,14 +119,15 @@ void report(int level, char *fmt, ...)
             va_end(ap);
         }
         va_start(ap, fmt);
-        vsnprintf(buffer, BUF_SIZE, fmt, ap);
+        vsnprintf(buffer, BUF_SIZE - 1, fmt, ap);
         va_end(ap);
-    }
-    if (web_connfd) {
-        int len = strlen(buffer);
-        buffer[len] = '\n';
-        buffer[len + 1] = '\0';
-        web_send(web_connfd, buffer);
+
+        if (web_connfd) {
+            int len = strlen(buffer);
+            buffer[len] = '\n';
+            buffer[len + 1] = '\0';
+            web_send(web_connfd, buffer);
+        }
     }
 }
 
@@ -152,10 +153,10 @@ void report_noreturn(int level, char *fmt, ...)
         va_start(ap, fmt);
         vsnprintf(buffer, BUF_SIZE, fmt, ap);
         va_end(ap);
-    }
 
-    if (web_connfd)
-        web_send(web_connfd, buffer);
+        if (web_connfd)
+            web_send(web_connfd, buffer);
+    }
 }
 
 /* Functions denoting failures */
@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <math.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -7,11 +8,13 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "dudect/cpucycles.h"
+#include "dudect/perfcounter.h"
 #include "harness.h"
 #include "list.h"
 #include "listsort.h"
+#include "parallelsort.h"
 #include "queue.h"
+#include "radixsort.h"
 #include "random.h"
 #include "sort_test.h"
 #include "sort_test_impl.h"
@@ -20,19 +23,14 @@
 #define MIN_RANDSTR_LEN 5
 #define MAX_STR_LEN 10
 #define MAX_LOOP 10
-#define N_MEASURES 15 /* loop for testing each number of nodes */
 #define MAX_CASES 6
 
-/* The range of the elements is cited from the `listsort.txt` in cpython */
-#define MIN_NODE 0
+/* The range of the elements is cited from the `listsort.txt` in cpython, and
+ * the case of random 3 elements needs at least 3 distinct nodes to pick */
+#define MIN_NODE 4
 #define MAX_NODE 1048576  // 2^20
 
-#define COMP_OUT "comparison_output.txt"
-#define K_OUT "kvalue_output.txt"
-#define DUR_OUT "time_output.txt"
-
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
-char *prefix = ""; /* prefix of the file name by the form of test case */
 
 /* TODO: Add a buf_size check of if the buf_size may be less
  * than MIN_RANDSTR_LEN.
@@ -44,7 +42,7 @@ void fill_rand_string(char *buf, size_t buf_size)
         len = rand() % buf_size;
 
     uint64_t randstr_buf_64[MAX_STR_LEN] = {0};
-    randombytes((uint8_t *) randstr_buf_64, len * sizeof(uint64_t));
+    prng_fill((uint8_t *) randstr_buf_64, len * sizeof(uint64_t));
     for (size_t n = 0; n < len; n++)
         buf[n] = charset[randstr_buf_64[n] % (sizeof(charset) - 1)];
 
@@ -85,12 +83,29 @@ void fill_cont_full_string(char *buf, size_t buf_size, int counter, size_t bias)
     } while (num != 0);
 }
 
-void create_sample(struct list_head *head,
+/* Copy the string of an element, which is shared through the string pool if
+ * the strings are interned. Return NULL if out of memory. */
+static char *copy_string(const char *s)
+{
+    if (q_intern_strings)
+        return q_str_intern(s);
+    size_t s_len = strlen(s) + 1;
+    char *copy = malloc(s_len);
+    if (!copy)
+        return NULL;
+    memcpy(copy, s, s_len);
+    return copy;
+}
+
+/* Create the sample of the case @case_id in @head. Return false if out of
+ * memory, the nodes created so far are left in @head. */
+bool create_sample(struct list_head *head,
                    element_t *space,
                    int samples,
                    int case_id)
 {
-    char randstr_buf[MAX_STR_LEN], worststr_buf[MAX_STR_LEN];
+    /* the continuous strings fill all of the MAX_STR_LEN characters */
+    char randstr_buf[MAX_STR_LEN], worststr_buf[MAX_STR_LEN + 1] = {0};
     char *inserts = NULL;
 
     int cnt = 0, exch[100000]; /* variables for random slots */
@@ -101,7 +116,6 @@ void create_sample(struct list_head *head,
     switch (case_id) {
     case 0: /* Worst case of merge sort */
         inserts = worststr_buf;
-        prefix = "w_";
         break;
     case 1: /* Random 3 elements */
         for (int i = 0; i < 3; i++) {
@@ -123,11 +137,9 @@ void create_sample(struct list_head *head,
         }
 
         inserts = worststr_buf;
-        prefix = "r3_";
         break;
     case 2: /* Random last 10 elements */
         inserts = worststr_buf;
-        prefix = "rl10_";
         break;
     case 3: /* Random 1% elements */
         int num = samples * 0.01;
@@ -153,15 +165,12 @@ void create_sample(struct list_head *head,
         }
 
         inserts = worststr_buf;
-        prefix = "r1p_";
         break;
     case 4: /* Duplicate */
         inserts = randstr_buf;
-        prefix = "dup_";
         break;
     default: /* Random elements */
         inserts = randstr_buf;
-        prefix = "r_";
         break;
     }
 
@@ -170,30 +179,27 @@ void create_sample(struct list_head *head,
         element_t *elem = space + i;
         switch (case_id) {
         case 0: /* Worst case of merge sort */
-            fill_cont_full_string(worststr_buf, sizeof(worststr_buf), i, bias);
+            fill_cont_full_string(worststr_buf, MAX_STR_LEN, i, bias);
             break;
         case 1: /* Random 3 elements */
             if (i == exch[cnt]) {
-                fill_rand_string(worststr_buf, sizeof(worststr_buf));
+                fill_rand_string(worststr_buf, MAX_STR_LEN);
                 cnt++;
             } else
-                fill_cont_full_string(worststr_buf, sizeof(worststr_buf), i,
-                                      bias);
+                fill_cont_full_string(worststr_buf, MAX_STR_LEN, i, bias);
             break;
         case 2: /* Random last 10 elements */
             if (i < samples - 10)
-                fill_cont_full_string(worststr_buf, sizeof(worststr_buf), i,
-                                      bias);
+                fill_cont_full_string(worststr_buf, MAX_STR_LEN, i, bias);
             else
-                fill_rand_string(worststr_buf, sizeof(worststr_buf));
+                fill_rand_string(worststr_buf, MAX_STR_LEN);
             break;
         case 3: /* Random 1% elements */
             if (i == exch[cnt]) {
-                fill_rand_string(worststr_buf, sizeof(worststr_buf));
+                fill_rand_string(worststr_buf, MAX_STR_LEN);
                 cnt++;
             } else
-                fill_cont_full_string(worststr_buf, sizeof(worststr_buf), i,
-                                      bias);
+                fill_cont_full_string(worststr_buf, MAX_STR_LEN, i, bias);
             break;
         case 4: /* Duplicate */
             if (i == 0 || (!dup && !(rand() % 2))) {
@@ -207,34 +213,44 @@ void create_sample(struct list_head *head,
             break;
         }
 
-        int s_len = strlen(inserts) + 1;
-        elem->value = (char *) malloc(s_len * sizeof(char));
-        memcpy(elem->value, inserts, s_len);
-        elem->seq = i;
+        elem->value = copy_string(inserts);
+        if (!elem->value)
+            return false;
+        elem->interned = q_intern_strings;
+        elem->key = q_key_prefix(elem->value);
         list_add_tail(&elem->list, head);
     }
 
     /* handle special cases for furthur modification */
     if (!case_id)
         worst_case_generator(head);
-    else if (case_id == 4 && samples < 25000)
+    else if (case_id == 4)
         shuffle(head);
+
+    /* number the nodes in their final order to check the sort stability */
+    int seq = 0;
+    element_t *elem;
+    list_for_each_entry (elem, head, list)
+        elem->seq = seq++;
+    return true;
 }
 
-void copy_list(struct list_head *from, struct list_head *to, element_t *space)
+/* Copy the list @from to @to. Return false if out of memory, the nodes copied
+ * so far are left in @to. */
+bool copy_list(struct list_head *from, struct list_head *to, element_t *space)
 {
-    if (list_empty(from))
-        return;
-
     element_t *entry;
     list_for_each_entry (entry, from, list) {
         element_t *copy = space++;
-        int s_len = strlen(entry->value) + 1;
-        copy->value = (char *) malloc(s_len * sizeof(char));
-        memcpy(copy->value, entry->value, s_len);
+        copy->value = copy_string(q_value(entry));
+        if (!copy->value)
+            return false;
+        copy->interned = q_intern_strings;
+        copy->key = entry->key;
         copy->seq = entry->seq;
         list_add_tail(&copy->list, to);
     }
+    return true;
 }
 
 int compare(void *priv, const struct list_head *a, const struct list_head *b)
@@ -242,7 +258,7 @@ int compare(void *priv, const struct list_head *a, const struct list_head *b)
     element_t *element_a = list_entry(a, element_t, list);
     element_t *element_b = list_entry(b, element_t, list);
 
-    int res = strcmp(element_a->value, element_b->value);
+    int res = q_value_cmp(element_a, element_b);
 
     if (!res)
         return 0;
@@ -253,7 +269,7 @@ int compare(void *priv, const struct list_head *a, const struct list_head *b)
     return res;
 }
 
-bool check_list(struct list_head *head, int count)
+bool check_list(struct list_head *head, int count, bool descend)
 {
     if (list_empty(head))
         return 0 == count;
@@ -266,11 +282,13 @@ bool check_list(struct list_head *head, int count)
     int unstable = 0;
     list_for_each_entry_safe (entry, safe, head, list) {
         if (entry->list.next != head) {
-            if (strcmp(entry->value, safe->value) > 0) {
+            int res = strcmp(q_value(entry), q_value(safe));
+            if ((!descend && res > 0) || (descend && res < 0)) {
                 fprintf(stderr, "\nERROR: Wrong order\n");
                 return false;
             }
-            if (!strcmp(entry->value, safe->value) && entry->seq > safe->seq)
+            /* equal elements keep their original order in both directions */
+            if (!res && entry->seq > safe->seq)
                 unstable++;
         }
     }
@@ -279,8 +297,8 @@ bool check_list(struct list_head *head, int count)
         return false;
     }
 
-    if (ctr < MIN_NODE && ctr > MAX_NODE) {
-        fprintf(stderr, "\nERROR: Inconsistent number of elements: %ld\n", ctr);
+    if (ctr != (size_t) count) {
+        fprintf(stderr, "\nERROR: Inconsistent number of elements: %zu\n", ctr);
         return false;
     }
     return true;
@@ -288,6 +306,7 @@ bool check_list(struct list_head *head, int count)
 
 typedef void (*test_func_t)(void *priv,
                             struct list_head *head,
+                            bool descend,
                             list_cmp_func_t cmp);
 
 typedef struct {
@@ -295,197 +314,384 @@ typedef struct {
     test_func_t impl;
 } test_t;
 
+/* The sorting algorithms to measure */
+static const test_t tests[] = {
+    {.name = "timsort", .impl = timsort},
+    {.name = "listsort", .impl = list_sort},
+    {.name = "timsort_old", .impl = timsort_old},
+    {.name = "timsort_gallop", .impl = timsort_gallop},
+    {.name = "timsort_binary", .impl = timsort_binary},
+    {.name = "radixsort", .impl = radix_sort},
+    {.name = "parallelsort", .impl = parallel_sort},
+    {.name = "qsort", .impl = sort},
+};
+#define N_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+/* The data distributions, in the order of the cases of create_sample() */
+static const char *const distributions[MAX_CASES] = {
+    "worst", "random3", "random_last10", "random_1percent", "duplicate",
+    "random",
+};
+
+/* The integer measurements, the comparisons come after the counters */
+#define M_COMPARISONS N_PERF_COUNTERS
+#define N_METRICS (N_PERF_COUNTERS + 1)
+
+/* The percentiles reported for each measurement */
+static const int percentiles[] = {50, 90, 99};
+static const char *const percentile_names[] = {"median", "p90", "p99"};
+#define N_PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
 /* To get the k-value from the current number of comparisons and nodes */
 double k_value(int n, int comp)
 {
     return log2(n) - (double) (comp - 1) / n;
 }
 
-/* output the results to the specific files */
-void file_output(int samples,
-                 char *name_prefix,
-                 int64_t duration,
-                 int count,
-                 double k)
+static int cmp_int64(const void *a, const void *b)
 {
-    int n_len = strlen(name_prefix) + 1;
-    char *file_name = (char *) malloc((n_len + 100) * sizeof(char));
-    if (!file_name) {
-        free(file_name);
-        perror("Out of memmory while copying file name");
-        exit(EXIT_FAILURE);
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* The nearest-rank percentile of @n sorted values */
+static inline size_t percentile_rank(int percentile, size_t n)
+{
+    size_t rank = (percentile * n + 99) / 100;
+    return rank ? rank - 1 : 0;
+}
+
+/* Mark the names of the comma-separated @list in @selected, where NULL selects
+ * all of them. Return false if the list has an unknown name. */
+static bool select_names(const char *list,
+                         const char *const *names,
+                         size_t n,
+                         bool *selected)
+{
+    for (size_t i = 0; i < n; i++)
+        selected[i] = !list;
+
+    while (list && *list) {
+        size_t len = strcspn(list, ",");
+        size_t i;
+        for (i = 0; i < n; i++) {
+            if (strlen(names[i]) == len && !strncmp(names[i], list, len))
+                break;
+        }
+        if (i == n) {
+            fprintf(stderr, "ERROR: Unknown name '%.*s'\n", (int) len, list);
+            return false;
+        }
+        selected[i] = true;
+        list += len;
+        list += *list == ',';
     }
+    return true;
+}
+
+void sort_test_list(void)
+{
+    printf("Sorting algorithms:");
+    for (size_t i = 0; i < N_TESTS; i++)
+        printf(" %s", tests[i].name);
+    printf("\nData distributions:");
+    for (size_t i = 0; i < MAX_CASES; i++)
+        printf(" %s", distributions[i]);
+    printf("\n");
+}
 
-    memcpy(file_name, name_prefix, n_len);
-    strcat(file_name, DUR_OUT);
-    FILE *dur_output = fopen(file_name, "a");
-    if (!dur_output) {
-        perror("The output file `time_output.txt` might have been collapsed");
-        exit(EXIT_FAILURE);
+/* The name of the integer measurement @m, which are the counters of
+ * perfcounter.h followed by the comparisons */
+static const char *metric_name(int m)
+{
+    return m < N_PERF_COUNTERS ? perf_counter_names[m] : "comparisons";
+}
+
+/* Write a count, which is missing if its counter is not available */
+static void print_count(const sort_bench_t *bench, int64_t count)
+{
+    if (count >= 0)
+        fprintf(bench->output, "%" PRId64, count);
+    else if (bench->json)
+        fprintf(bench->output, "null");
+}
+
+static void bench_header(const sort_bench_t *bench)
+{
+    if (bench->json) {
+        fprintf(bench->output, "[");
+        return;
     }
 
-    memset(file_name, '\0', strlen(file_name));
-    memcpy(file_name, name_prefix, n_len);
-    strcat(file_name, COMP_OUT);
-    FILE *comp_output = fopen(file_name, "a");
-    if (!dur_output) {
-        perror(
-            "The output file `comparison_output.txt` might have been "
-            "collapsed");
-        exit(EXIT_FAILURE);
+    fprintf(bench->output, "engine,distribution,nodes,repeats");
+    for (int m = 0; m < N_METRICS; m++) {
+        for (size_t p = 0; p < N_PERCENTILES; p++)
+            fprintf(bench->output, ",%s_%s", metric_name(m),
+                    percentile_names[p]);
     }
+    for (size_t p = 0; p < N_PERCENTILES; p++)
+        fprintf(bench->output, ",k_%s", percentile_names[p]);
+    fprintf(bench->output, "\n");
+}
 
-    memset(file_name, '\0', strlen(file_name));
-    memcpy(file_name, name_prefix, n_len);
-    strcat(file_name, K_OUT);
-    FILE *k_output = fopen(file_name, "a");
-    if (!k_output) {
-        perror(
-            "The output file `comparison_output.txt` might have been "
-            "collapsed");
-        exit(EXIT_FAILURE);
+/* Write the percentiles of the measurements of one algorithm on one number of
+ * nodes, the measurements are sorted in place */
+static void bench_record(const sort_bench_t *bench,
+                         bool first,
+                         const char *name,
+                         int case_id,
+                         int nodes,
+                         int64_t *metrics[N_METRICS],
+                         double *k)
+{
+    FILE *out = bench->output;
+    size_t n = bench->repeats;
+    for (int m = 0; m < N_METRICS; m++)
+        qsort(metrics[m], n, sizeof(*metrics[m]), cmp_int64);
+    qsort(k, n, sizeof(*k), cmp_double);
+
+    if (!bench->json) {
+        fprintf(out, "%s,%s,%d,%d", name, distributions[case_id], nodes,
+                bench->repeats);
+        for (int m = 0; m < N_METRICS; m++) {
+            for (size_t p = 0; p < N_PERCENTILES; p++) {
+                fprintf(out, ",");
+                print_count(bench,
+                            metrics[m][percentile_rank(percentiles[p], n)]);
+            }
+        }
+        for (size_t p = 0; p < N_PERCENTILES; p++)
+            fprintf(out, ",%f", k[percentile_rank(percentiles[p], n)]);
+        fprintf(out, "\n");
+        fflush(out);
+        return;
     }
 
-    fprintf(dur_output, "%10d %10ld\n", samples, duration);
-    fprintf(comp_output, "%10d %10d\n", samples, count);
-    fprintf(k_output, "%10d %10f\n", samples, k);
+    fprintf(out,
+            "%s\n  {\"engine\": \"%s\", \"distribution\": \"%s\", "
+            "\"nodes\": %d, \"repeats\": %d",
+            first ? "" : ",", name, distributions[case_id], nodes,
+            bench->repeats);
+    for (int m = 0; m < N_METRICS; m++) {
+        fprintf(out, ",\n   \"%s\": {", metric_name(m));
+        for (size_t p = 0; p < N_PERCENTILES; p++) {
+            fprintf(out, "%s\"%s\": ", p ? ", " : "", percentile_names[p]);
+            print_count(bench, metrics[m][percentile_rank(percentiles[p], n)]);
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, ",\n   \"k\": {");
+    for (size_t p = 0; p < N_PERCENTILES; p++)
+        fprintf(out, "%s\"%s\": %f", p ? ", " : "", percentile_names[p],
+                k[percentile_rank(percentiles[p], n)]);
+    fprintf(out, "}}");
+    fflush(out);
+}
 
-    fclose(dur_output);
-    fclose(comp_output);
-    fclose(k_output);
+static void bench_footer(const sort_bench_t *bench, bool empty)
+{
+    if (bench->json)
+        fprintf(bench->output, "%s]\n", empty ? "" : "\n");
+    fflush(bench->output);
+}
 
-    free(file_name);
+static void free_list(struct list_head *head)
+{
+    element_t *iterator, *next;
+    list_for_each_entry_safe (iterator, next, head, list) {
+        list_del(&iterator->list);
+        if (iterator->interned)
+            q_str_release(iterator->value);
+        else
+            test_free(iterator->value);
+    }
+}
+
+/* The number of nodes after @nodes in the sweep, or 0 past the end of it */
+static int next_nodes(const sort_bench_t *bench, int nodes)
+{
+    if (bench->geometric) {
+        if (nodes > bench->max_nodes / bench->step)
+            return 0;
+        return nodes * bench->step;
+    }
+    if (nodes > bench->max_nodes - bench->step)
+        return 0;
+    return nodes + bench->step;
 }
 
 /** Sorting test
  *
  * Apply a test program in user space for the given sorting algorithms.
  *
- * In this function, it expects to do the following tests for the sorting
- * algorithms:
- *  - Sorting stability
- *  - Worst case scenario in merge sort
- *  - Tim sort cases
- *
- * With the following expected outputs:
+ * For each of the selected data distributions and each number of nodes of the
+ * sweep, every repetition generates a new sample, and each of the selected
+ * sorting algorithms sorts its own copy of it after warming up on another.
+ * The warming sorts in the other order, and both of the results are checked
+ * to be in order and stable.
+ * The following outputs are measured:
+ *  - Cycles, instructions, branch misses and L1d misses of the sorting alone,
+ *    by the counters of perfcounter.h. Only the cycles are measured, by
+ *    cpucycles() of dudect, if the counters are not available.
  *  - Comparisons
- *  - Durations
+ *  - K-value
+ *
+ * Their median, p90 and p99 over the repetitions are written as one record
+ * per algorithm to the CSV or JSON stream of @bench.
+ *
+ * Return false if an algorithm leaves the list out of order or unstable, or if
+ * the memory runs out, and the run stops there.
  */
-bool sort_test(int case_id, int nodes)
+bool sort_test(const sort_bench_t *bench)
 {
-    struct list_head sample_head, testdata_head, warmdata_head;
-    int count;
-
-    /* Assume ASLR */
-    // srand((uintptr_t) &sort_test);
-
-    test_t tests[] = {
-        // {.name = "timsort", .impl = timsort},
-        // {.name = "listsort", .impl = list_sort},
-        // {.name = "timsort_old", .impl = timsort_old},
-        // {.name = "timsort_gallop", .impl = timsort_gallop},
-        {.name = "timsort_binary", .impl = timsort_binary},
-        // {.name = "qsort", .impl = sort},
-        {NULL, NULL},
-    };
-    test_t *test = tests;
-
-    while (test->impl) {
-        element_t *samples = malloc(sizeof(*samples) * nodes);
-        element_t *testdata = malloc(sizeof(*testdata) * nodes);
-        element_t *warmdata = malloc(sizeof(*warmdata) * nodes);
-
-        /* The execution time measurement refers to that from dudect, which
-           is different from the measurement in intepreter `qtest` */
-        int64_t *before_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
-        int64_t *after_ticks = calloc(N_MEASURES + 1, sizeof(int64_t));
-        int64_t *exec_times = calloc(N_MEASURES, sizeof(int64_t));
-        for (int i = 0; i < N_MEASURES; i++) {
-            // printf("==== Testing %s in %d nodes #%d ====\n", test->name,
-            // nodes, i);
-            /* initialize the linked-list */
-            INIT_LIST_HEAD(&sample_head);
-            create_sample(&sample_head, samples, nodes, case_id);
-
-            INIT_LIST_HEAD(&testdata_head);
-            INIT_LIST_HEAD(&warmdata_head);
-            copy_list(&sample_head, &testdata_head, testdata);
-            copy_list(&sample_head, &warmdata_head, warmdata);
-            /* Warming */
-            // printf("Warming\n");
-            test->impl(&count, &warmdata_head, compare);
-
-            /* Test */
-            // printf("Testing\n");
-            count = 0;
-            before_ticks[i] = cpucycles();
-            test->impl(&count, &testdata_head, compare);
-            after_ticks[i] = cpucycles();
-
-            exec_times[i] = after_ticks[i] - before_ticks[i];
-            double k = k_value(nodes, count);
-
-            // printf("  Durations:    %ld ticks\n", exec_times[i]);
-            // printf("  Comparisons:    %d\n", count);
-            // printf("  K-value:    %f\n", k);
-            // printf("  List is %s\n",
-            //     check_list(&testdata_head, nodes) ? "sorted" : "not sorted");
-            char LS_PREFIX[100] = "k_";
-            char TIM_PREFIX[100] = "t_";
-            char TIMO_PREFIX[100] = "to_";
-            char TIMB_PREFIX[100] = "tb_";
-            char TIMG_PREFIX[100] = "tg_";
-            char Q_PREFIX[100] = "q_";
-            if (!strcmp(test->name, "timsort"))
-                file_output(nodes, strcat(TIM_PREFIX, prefix), exec_times[i],
-                            count, k);
-            else if (!strcmp(test->name, "listsort"))
-                file_output(nodes, strcat(LS_PREFIX, prefix), exec_times[i],
-                            count, k);
-            else if (!strcmp(test->name, "timsort_old"))
-                file_output(nodes, strcat(TIMO_PREFIX, prefix), exec_times[i],
-                            count, k);
-            else if (!strcmp(test->name, "timsort_binary"))
-                file_output(nodes, strcat(TIMB_PREFIX, prefix), exec_times[i],
-                            count, k);
-            else if (!strcmp(test->name, "timsort_gallop"))
-                file_output(nodes, strcat(TIMG_PREFIX, prefix), exec_times[i],
-                            count, k);
-            else if (!strcmp(test->name, "qsort"))
-                file_output(nodes, strcat(Q_PREFIX, prefix), exec_times[i],
-                            count, k);
-
-            /* Clean the value and list in the current `element_t` structure */
-            element_t *iterator, *next;
-
-            list_for_each_entry_safe (iterator, next, &sample_head, list) {
-                list_del(&iterator->list);
-                test_free(iterator->value);
-            }
-
-            list_for_each_entry_safe (iterator, next, &warmdata_head, list) {
-                list_del(&iterator->list);
-                test_free(iterator->value);
-            }
-
-            list_for_each_entry_safe (iterator, next, &testdata_head, list) {
-                list_del(&iterator->list);
-                test_free(iterator->value);
-            }
+    if (bench->min_nodes < MIN_NODE || bench->max_nodes > MAX_NODE ||
+        bench->min_nodes > bench->max_nodes) {
+        fprintf(stderr, "ERROR: The number of nodes must be in [%d, %d]\n",
+                MIN_NODE, MAX_NODE);
+        return false;
+    }
+    if (bench->repeats < 1 || bench->step < 1 ||
+        (bench->geometric && bench->step < 2)) {
+        fprintf(stderr, "ERROR: Invalid repetitions or step of the sweep\n");
+        return false;
+    }
 
-            count = 0;
-        }
+    const char *names[N_TESTS];
+    for (size_t i = 0; i < N_TESTS; i++)
+        names[i] = tests[i].name;
+    bool test_selected[N_TESTS], case_selected[MAX_CASES];
+    if (!select_names(bench->engines, names, N_TESTS, test_selected) ||
+        !select_names(bench->distributions, distributions, MAX_CASES,
+                      case_selected))
+        return false;
 
+    size_t steps = 0;
+    for (int nodes = bench->min_nodes; nodes; nodes = next_nodes(bench, nodes))
+        steps++;
+    size_t n_cases = 0;
+    for (int c = 0; c < MAX_CASES; c++)
+        n_cases += case_selected[c];
+
+    /* The measurements of every algorithm, @repeats for each of them */
+    size_t n = bench->repeats;
+    int64_t *metrics[N_METRICS];
+    bool enough_memory = true;
+    for (int m = 0; m < N_METRICS; m++) {
+        metrics[m] = malloc(sizeof(*metrics[m]) * n * N_TESTS);
+        enough_memory &= !!metrics[m];
+    }
+    double *k = malloc(sizeof(*k) * n * N_TESTS);
+    element_t *samples = malloc(sizeof(*samples) * bench->max_nodes);
+    element_t *testdata = malloc(sizeof(*testdata) * bench->max_nodes);
+    element_t *warmdata = malloc(sizeof(*warmdata) * bench->max_nodes);
+    if (!enough_memory || !k || !samples || !testdata || !warmdata) {
+        fprintf(stderr, "ERROR: Out of memory for the sorting test\n");
+        for (int m = 0; m < N_METRICS; m++)
+            free(metrics[m]);
+        free(k);
         free(samples);
         free(testdata);
         free(warmdata);
+        return false;
+    }
 
-        free(before_ticks);
-        free(after_ticks);
-        free(exec_times);
+    bool first = true, ok = true;
+    size_t done = 0;
+    bench_header(bench);
+    for (int case_id = 0; ok && case_id < MAX_CASES; case_id++) {
+        if (!case_selected[case_id])
+            continue;
+
+        for (int nodes = bench->min_nodes; ok && nodes;
+             nodes = next_nodes(bench, nodes)) {
+            for (size_t r = 0; ok && r < n; r++) {
+                struct list_head sample_head;
+                INIT_LIST_HEAD(&sample_head);
+                if (!create_sample(&sample_head, samples, nodes, case_id)) {
+                    fprintf(stderr, "ERROR: Out of memory for the sample\n");
+                    ok = false;
+                }
+
+                for (size_t t = 0; ok && t < N_TESTS; t++) {
+                    if (!test_selected[t])
+                        continue;
+
+                    struct list_head testdata_head, warmdata_head;
+                    INIT_LIST_HEAD(&testdata_head);
+                    INIT_LIST_HEAD(&warmdata_head);
+                    if (!copy_list(&sample_head, &testdata_head, testdata) ||
+                        !copy_list(&sample_head, &warmdata_head, warmdata)) {
+                        fprintf(stderr,
+                                "ERROR: Out of memory for the sample\n");
+                        free_list(&warmdata_head);
+                        free_list(&testdata_head);
+                        ok = false;
+                        break;
+                    }
+
+                    /* Warming, which sorts in the other order so that both
+                     * of the orders are checked in every run */
+                    int count = 0;
+                    tests[t].impl(&count, &warmdata_head, !bench->descend,
+                                  compare);
+                    ok &= check_list(&warmdata_head, nodes, !bench->descend);
+
+                    /* Count only the sorting itself, which is different
+                     * from the measurement in intepreter `qtest` */
+                    perf_sample_t sample;
+                    count = 0;
+                    perf_start(&sample);
+                    tests[t].impl(&count, &testdata_head, bench->descend,
+                                  compare);
+                    perf_stop(&sample);
+                    ok &= check_list(&testdata_head, nodes, bench->descend);
+                    if (!ok)
+                        fprintf(stderr, "ERROR: %s failed on %s of %d nodes\n",
+                                tests[t].name, distributions[case_id], nodes);
+
+                    for (int m = 0; m < N_PERF_COUNTERS; m++)
+                        metrics[m][t * n + r] = sample.value[m];
+                    metrics[M_COMPARISONS][t * n + r] = count;
+                    k[t * n + r] = k_value(nodes, count);
+
+                    free_list(&warmdata_head);
+                    free_list(&testdata_head);
+                }
+                free_list(&sample_head);
+            }
+            if (!ok)
+                break;
+
+            for (size_t t = 0; t < N_TESTS; t++) {
+                if (!test_selected[t])
+                    continue;
+                int64_t *test_metrics[N_METRICS];
+                for (int m = 0; m < N_METRICS; m++)
+                    test_metrics[m] = metrics[m] + t * n;
+                bench_record(bench, first, tests[t].name, case_id, nodes,
+                             test_metrics, k + t * n);
+                first = false;
+            }
 
-        test++;
+            if (bench->output != stdout)
+                printf("Finish %.2f percent\n",
+                       (double) ++done / (steps * n_cases) * 100);
+        }
     }
+    bench_footer(bench, first);
 
-    return true;
-}
\ No newline at end of file
+    for (int m = 0; m < N_METRICS; m++)
+        free(metrics[m]);
+    free(k);
+    free(samples);
+    free(testdata);
+    free(warmdata);
+
+    return ok;
+}
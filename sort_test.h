@@ -2,4 +2,23 @@
  * This program tests the sorting algorithms
  */
 
-bool sort_test(int case_id, int nodes);
\ No newline at end of file
+#include <stdbool.h>
+#include <stdio.h>
+
+/* The settings of a run of the sorting test */
+typedef struct {
+    const char *engines;       /* comma-separated algorithms, NULL for all */
+    const char *distributions; /* comma-separated distributions, NULL for all */
+    int min_nodes, max_nodes;  /* the range of the number of nodes to sweep */
+    int step;       /* the number of nodes grows by this between the runs */
+    bool geometric; /* whether the number of nodes is multiplied by @step */
+    int repeats;    /* the measurements for each number of nodes */
+    bool descend;   /* measure the sorting in descending order */
+    bool json;      /* write JSON instead of CSV */
+    FILE *output;   /* the stream of the results */
+} sort_bench_t;
+
+/* Print the names of the sorting algorithms and the data distributions */
+void sort_test_list(void);
+
+bool sort_test(const sort_bench_t *bench);
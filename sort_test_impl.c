@@ -1,6 +1,7 @@
 #include <stdint.h>
 
 #include "queue.h"
+#include "random.h"
 #include "sort_test_impl.h"
 
 /* Merging two independent list (different from the implementation in `queue.c`)
@@ -23,24 +24,114 @@ struct list_head *merge_list(struct list_head *left, struct list_head *right)
     return head;
 }
 
-/* the shuffle algorithm introduced by Fisher–Yates */
-void shuffle(struct list_head *head)
+/* Merge two shuffled lists of @na and @nb nodes, taking the next node from
+ * either of them with the probability of its share of the remaining nodes, so
+ * that every interleaving is equally likely */
+static struct list_head *random_merge(struct list_head *a,
+                                      size_t na,
+                                      struct list_head *b,
+                                      size_t nb)
+{
+    struct list_head *head = NULL;
+    struct list_head **p = &head;
+    for (; na && nb; p = &((*p)->next)) {
+        if (prng_next() % (na + nb) < na) {
+            *p = a;
+            a = a->next;
+            na--;
+        } else {
+            *p = b;
+            b = b->next;
+            nb--;
+        }
+    }
+    *p = na ? a : b;
+    return head;
+}
+
+/**
+ * Shuffle the list without allocating memory, by a bottom-up merge sort whose
+ * merges pick the nodes at random. It takes O(n log n) time, and every
+ * permutation is equally likely.
+ */
+static void merge_shuffle(struct list_head *head)
 {
-    int len = q_size(head);
-    struct list_head *pos, *safe;
-    /* similar as `list_for_each_entry_safe` in Linux Kernel List Management API
-     */
-    for (pos = head->next, safe = pos->next; pos != head && len;
-         pos = safe, safe = safe->next, len--) {
-        struct list_head *j = head->next;
-        /* randomly choose a number between 0~(len - 1) */
-        for (int r = rand() % len; r;
-             r--) /* the seed `srand` had been defined in qtest*/
-            j = j->next;
-        if (pos == j)
+    /* pending[i] is either NULL or a shuffled list of 2^i nodes */
+    struct list_head *pending[sizeof(size_t) * 8] = {NULL};
+    size_t levels = 0;
+    struct list_head *list = head->next;
+    head->prev->next = NULL;
+    while (list) {
+        struct list_head *carry = list;
+        list = list->next;
+        carry->next = NULL;
+        size_t i;
+        for (i = 0; pending[i]; i++) {
+            carry = random_merge(pending[i], (size_t) 1 << i, carry,
+                                 (size_t) 1 << i);
+            pending[i] = NULL;
+        }
+        pending[i] = carry;
+        if (i >= levels)
+            levels = i + 1;
+    }
+
+    struct list_head *result = NULL;
+    size_t n = 0;
+    for (size_t i = 0; i < levels; i++) {
+        if (!pending[i])
             continue;
-        list_swap(pos, j); /* from Linux Kernel List Management API */
+        result = random_merge(pending[i], (size_t) 1 << i, result, n);
+        n += (size_t) 1 << i;
+    }
+
+    /* rebuild the `prev` pointers and make the list circular again */
+    struct list_head *curr;
+    head->next = result;
+    for (curr = head; curr->next; curr = curr->next)
+        curr->next->prev = curr;
+    curr->next = head;
+    curr->next->prev = curr;
+}
+
+/**
+ * The shuffle algorithm introduced by Fisher–Yates, on an array of the nodes
+ * which is relinked into the list at the end, so it takes O(n) time. Without
+ * the array, either because allocations are disallowed or malloc fails, the
+ * list is shuffled by merge_shuffle() instead.
+ */
+void shuffle(struct list_head *head)
+{
+    size_t len = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        len++;
+    if (len < 2)
+        return;
+
+    struct list_head **nodes = NULL;
+    if (!is_noallocate_mode())
+        nodes = malloc(len * sizeof(*nodes));
+    if (!nodes) {
+        merge_shuffle(head);
+        return;
+    }
+
+    size_t i = 0;
+    list_for_each (node, head)
+        nodes[i++] = node;
+    for (i = len - 1; i > 0; i--) {
+        /* randomly choose a number between 0~i */
+        size_t j = prng_next() % (i + 1);
+        struct list_head *tmp = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = tmp;
     }
+
+    INIT_LIST_HEAD(head);
+    for (i = 0; i < len; i++)
+        list_add_tail(nodes[i], head);
+    free(nodes);
 }
 
 /**
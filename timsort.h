@@ -1,6 +1,34 @@
+#ifndef LAB0_TIMSORT_H
+#define LAB0_TIMSORT_H
+
+#include "list.h"
 #include "listsort.h"
 
-void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp);
-void timsort_old(void *priv, struct list_head *head, list_cmp_func_t cmp);
-void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp);
-void timsort_gallop(void *priv, struct list_head *head, list_cmp_func_t cmp);
\ No newline at end of file
+/* Count the nodes of the list, which is not necessarily created by q_new() */
+static inline int list_length(struct list_head *head)
+{
+    int len = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        len++;
+    return len;
+}
+
+void timsort(void *priv,
+             struct list_head *head,
+             bool descend,
+             list_cmp_func_t cmp);
+void timsort_old(void *priv,
+                 struct list_head *head,
+                 bool descend,
+                 list_cmp_func_t cmp);
+void timsort_binary(void *priv,
+                    struct list_head *head,
+                    bool descend,
+                    list_cmp_func_t cmp);
+void timsort_gallop(void *priv,
+                    struct list_head *head,
+                    bool descend,
+                    list_cmp_func_t cmp);
+
+#endif /* LAB0_TIMSORT_H */
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,9 +23,9 @@ struct pair {
 };
 
 static size_t stk_size;
-
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
+                               bool descend,
                                struct list_head *a,
                                struct list_head *b)
 {
@@ -33,7 +34,7 @@ static struct list_head *merge(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
@@ -72,6 +73,7 @@ static void build_prev_link(struct list_head *head,
 
 static void merge_final(void *priv,
                         list_cmp_func_t cmp,
+                        bool descend,
                         struct list_head *head,
                         struct list_head *a,
                         struct list_head *b)
@@ -80,7 +82,7 @@ static void merge_final(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             tail->next = a;
             a->prev = tail;
             tail = a;
@@ -105,7 +107,8 @@ static void merge_final(void *priv,
 
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            bool descend)
 {
     // printf("start find run\n");
     size_t len = 1;
@@ -117,7 +120,7 @@ static struct pair find_run(void *priv,
         return result;
     }
 
-    if (cmp(priv, list, next) > 0) {
+    if (sort_cmp(priv, cmp, descend, list, next) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
         do {
@@ -127,14 +130,14 @@ static struct pair find_run(void *priv,
             list = next;
             next = list->next;
             head = list;
-        } while (next && cmp(priv, list, next) > 0);
+        } while (next && sort_cmp(priv, cmp, descend, list, next) > 0);
         list->next = prev;
     } else {
         do {
             len++;
             list = next;
             next = list->next;
-        } while (next && cmp(priv, list, next) <= 0);
+        } while (next && sort_cmp(priv, cmp, descend, list, next) <= 0);
         list->next = NULL;
     }
 
@@ -153,8 +156,9 @@ static struct pair find_run(void *priv,
              len++) {
             struct list_head *safe = in_node->next;
 
-            /* holding special case for being smaller than the head node */
-            if (cmp(priv, in_node, head) <= 0) {
+            /* holding special case for being smaller than the head node, an
+             * equal node goes after it for sort stability */
+            if (sort_cmp(priv, cmp, descend, in_node, head) < 0) {
                 in_node->prev = head->prev;
                 in_node->next = head;
                 head->prev = in_node;
@@ -194,7 +198,7 @@ static struct pair find_run(void *priv,
                 }
 
                 /* decide the direction of the next move */
-                if (cmp(priv, in_node, curr) > 0) {
+                if (sort_cmp(priv, cmp, descend, in_node, curr) >= 0) {
                     x = middle;
                     direction = 1;
                 } else {
@@ -209,7 +213,8 @@ static struct pair find_run(void *priv,
                     if (!direction) {
                         /* hold the insertion slot is before the first node of
                          * the section */
-                        if (cmp(priv, in_node, curr->prev) <= 0) {
+                        if (sort_cmp(priv, cmp, descend, in_node,
+                                     curr->prev) < 0) {
                             curr = curr->prev;
                             in_node->prev = curr->prev;
                             in_node->next = curr;
@@ -218,7 +223,8 @@ static struct pair find_run(void *priv,
                     } else {
                         /* hold the insertion slot is after the last node of the
                          * section  */
-                        if (cmp(priv, in_node, curr->next) > 0) {
+                        if (sort_cmp(priv, cmp, descend, in_node,
+                                     curr->next) >= 0) {
                             curr = curr->next;
                             in_node->prev = curr;
                             in_node->next = curr->next;
@@ -244,11 +250,12 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
+                                  bool descend,
                                   struct list_head *at)
 {
     size_t len = run_size(at) + run_size(at->prev);
     struct list_head *prev = at->prev->prev;
-    struct list_head *list = merge(priv, cmp, at->prev, at);
+    struct list_head *list = merge(priv, cmp, descend, at->prev, at);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
     --stk_size;
@@ -257,13 +264,14 @@ static struct list_head *merge_at(void *priv,
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
+                                              bool descend,
                                               struct list_head *tp)
 {
     while (stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, descend, tp->prev);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, descend, tp);
         }
     }
     return tp;
@@ -271,6 +279,7 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
+                                        bool descend,
                                         struct list_head *tp)
 {
     int n;
@@ -280,12 +289,12 @@ static struct list_head *merge_collapse(void *priv,
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, descend, tp->prev);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, descend, tp);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, descend, tp);
         } else {
             break;
         }
@@ -308,10 +317,13 @@ static int find_minrun_b(int size)
     return size + one;
 }
 
-void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp)
+void timsort_binary(void *priv,
+                    struct list_head *head,
+                    bool descend,
+                    list_cmp_func_t cmp)
 {
     stk_size = 0;
-    minrun_b = find_minrun_b(q_size(head));
+    minrun_b = find_minrun_b(list_length(head));
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
@@ -322,16 +334,16 @@ void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, descend);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
         stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        tp = merge_collapse(priv, cmp, descend, tp);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, descend, tp);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
@@ -341,5 +353,5 @@ void timsort_binary(void *priv, struct list_head *head, list_cmp_func_t cmp)
         build_prev_link(head, head, stk0);
         return;
     }
-    merge_final(priv, cmp, head, stk1, stk0);
+    merge_final(priv, cmp, descend, head, stk1, stk0);
 }
\ No newline at end of file
@@ -0,0 +1,429 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "list.h"
+#include "queue.h"
+#include "timsort.h"
+
+/* The initial threshold to enter the galloping mode, the same as the
+ * `MIN_GALLOP` in `listsort.txt` of cpython */
+#define MIN_GALLOP 7
+
+static int minrun_g = 0;
+static int min_gallop = MIN_GALLOP;
+
+static inline size_t run_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+    if (!head->next)
+        return 1;
+    return (size_t) (head->next->prev);
+}
+
+struct pair {
+    struct list_head *head, *next;
+};
+
+static size_t stk_size;
+/* Whether @node should be placed before @key in the merged list. Nodes from
+ * the left run go first on ties, so @strict is set when @node comes from the
+ * right run. */
+static inline bool goes_before(void *priv,
+                               list_cmp_func_t cmp,
+                               bool descend,
+                               struct list_head *node,
+                               struct list_head *key,
+                               bool strict)
+{
+    int res = sort_cmp(priv, cmp, descend, node, key);
+    return strict ? res < 0 : res <= 0;
+}
+
+/* Find the leading nodes of @list which go before @key by probing the nodes
+ * 1, 2, 4, ... positions ahead, then narrowing the last interval down with a
+ * binary search. It takes O(log n) comparisons to take n nodes at once.
+ *
+ * Return: the number of the nodes to take, and store the last of them in @last
+ */
+static int gallop(void *priv,
+                  list_cmp_func_t cmp,
+                  bool descend,
+                  struct list_head *key,
+                  struct list_head *list,
+                  bool strict,
+                  struct list_head **last)
+{
+    if (!goes_before(priv, cmp, descend, list, key, strict))
+        return 0;
+
+    int count = 1, step = 1;
+    *last = list;
+    for (;;) {
+        /* exponential search */
+        struct list_head *probe = *last;
+        int dist = 0;
+        while (dist < step && probe->next) {
+            probe = probe->next;
+            dist++;
+        }
+        if (!dist)
+            return count; /* the whole list goes before @key */
+
+        if (goes_before(priv, cmp, descend, probe, key, strict)) {
+            *last = probe;
+            count += dist;
+            step <<= 1;
+            continue;
+        }
+
+        /* binary search among the nodes between *last and probe */
+        for (int n = dist - 1; n;) {
+            int half = (n + 1) >> 1;
+            struct list_head *mid = *last;
+            for (int i = 0; i < half; i++)
+                mid = mid->next;
+            if (goes_before(priv, cmp, descend, mid, key, strict)) {
+                *last = mid;
+                count += half;
+                n -= half;
+            } else {
+                n = half - 1;
+            }
+        }
+        return count;
+    }
+}
+
+/* Find the slot of @in_node in the run ending with @tail by galloping
+ * backward, i.e. probing the nodes 1, 2, 4, ... positions before @tail, then
+ * narrowing the last interval down with a binary search.
+ *
+ * Return: the last node not greater than @in_node, or NULL if @in_node goes
+ * before the whole run
+ */
+static struct list_head *gallop_back(void *priv,
+                                     list_cmp_func_t cmp,
+                                     bool descend,
+                                     struct list_head *tail,
+                                     struct list_head *in_node)
+{
+    /* stop at an equal node -- important for sort stability */
+    if (sort_cmp(priv, cmp, descend, tail, in_node) <= 0)
+        return tail;
+
+    struct list_head *above = tail; /* the first node known to be greater */
+    for (int step = 1;; step <<= 1) {
+        /* exponential search */
+        struct list_head *probe = above;
+        int dist = 0;
+        while (dist < step && probe->prev) {
+            probe = probe->prev;
+            dist++;
+        }
+        if (!dist)
+            return NULL;
+        if (sort_cmp(priv, cmp, descend, probe, in_node) > 0) {
+            above = probe;
+            continue;
+        }
+
+        /* binary search among the nodes between probe and above */
+        for (int n = dist - 1; n;) {
+            int half = (n + 1) >> 1;
+            struct list_head *mid = probe;
+            for (int i = 0; i < half; i++)
+                mid = mid->next;
+            if (sort_cmp(priv, cmp, descend, mid, in_node) <= 0) {
+                probe = mid;
+                n -= half;
+            } else {
+                n = half - 1;
+            }
+        }
+        return probe;
+    }
+}
+
+static struct list_head *merge(void *priv,
+                               list_cmp_func_t cmp,
+                               bool descend,
+                               struct list_head *a,
+                               struct list_head *b)
+{
+    struct list_head *head = NULL, *last;
+    struct list_head **tail = &head;
+
+    for (;;) {
+        int a_wins = 0, b_wins = 0;
+
+        /* Compare one pair at a time until a run keeps winning */
+        do {
+            /* if equal, take 'a' -- important for sort stability */
+            if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
+                *tail = a;
+                tail = &a->next;
+                a = a->next;
+                if (!a) {
+                    *tail = b;
+                    return head;
+                }
+                a_wins++;
+                b_wins = 0;
+            } else {
+                *tail = b;
+                tail = &b->next;
+                b = b->next;
+                if (!b) {
+                    *tail = a;
+                    return head;
+                }
+                b_wins++;
+                a_wins = 0;
+            }
+        } while (a_wins < min_gallop && b_wins < min_gallop);
+
+        /* Galloping mode: stay as long as it takes long streaks of nodes, and
+         * make it easier to enter next time */
+        ++min_gallop;
+        do {
+            if (min_gallop > 1)
+                --min_gallop;
+
+            a_wins = gallop(priv, cmp, descend, b, a, false, &last);
+            if (a_wins) {
+                *tail = a;
+                tail = &last->next;
+                a = last->next;
+                if (!a) {
+                    *tail = b;
+                    return head;
+                }
+            }
+
+            b_wins = gallop(priv, cmp, descend, a, b, true, &last);
+            if (b_wins) {
+                *tail = b;
+                tail = &last->next;
+                b = last->next;
+                if (!b) {
+                    *tail = a;
+                    return head;
+                }
+            }
+        } while (a_wins >= MIN_GALLOP || b_wins >= MIN_GALLOP);
+        /* Penalize leaving the galloping mode */
+        ++min_gallop;
+    }
+}
+
+static void build_prev_link(struct list_head *head,
+                            struct list_head *tail,
+                            struct list_head *list)
+{
+    tail->next = list;
+    do {
+        list->prev = tail;
+        tail = list;
+        list = list->next;
+    } while (list);
+
+    /* The final links to make a circular doubly-linked list */
+    tail->next = head;
+    head->prev = tail;
+}
+
+static void merge_final(void *priv,
+                        list_cmp_func_t cmp,
+                        bool descend,
+                        struct list_head *head,
+                        struct list_head *a,
+                        struct list_head *b)
+{
+    build_prev_link(head, head, merge(priv, cmp, descend, a, b));
+}
+
+static struct pair find_run(void *priv,
+                            struct list_head *list,
+                            list_cmp_func_t cmp,
+                            bool descend)
+{
+    size_t len = 1;
+    struct list_head *next = list->next, *head = list, *tail = list;
+    struct pair result;
+
+    if (!next) {
+        result.head = head, result.next = next;
+        return result;
+    }
+
+    if (sort_cmp(priv, cmp, descend, list, next) > 0) {
+        /* decending run, also reverse the list */
+        struct list_head *prev = NULL;
+        do {
+            len++;
+            list->next = prev;
+            prev = list;
+            list = next;
+            next = list->next;
+            head = list;
+        } while (next && sort_cmp(priv, cmp, descend, list, next) > 0);
+        list->next = prev;
+    } else {
+        do {
+            len++;
+            list = next;
+            next = list->next;
+        } while (next && sort_cmp(priv, cmp, descend, list, next) <= 0);
+        list->next = NULL;
+        tail = list;
+    }
+
+    /* Extend a short run to `minrun_g` nodes by insertion sort. The slot is
+     * searched from the tail of the run since the following nodes of a
+     * mostly-sorted input tend to belong to the end of it. */
+    if (next && len < minrun_g) {
+        head->prev = NULL;
+        for (struct list_head *curr = head; curr->next; curr = curr->next)
+            curr->next->prev = curr;
+
+        for (; next && len < minrun_g; len++) {
+            struct list_head *in_node = next;
+            next = next->next;
+
+            struct list_head *pos =
+                gallop_back(priv, cmp, descend, tail, in_node);
+            if (!pos) {
+                in_node->prev = NULL;
+                in_node->next = head;
+                head->prev = in_node;
+                head = in_node;
+            } else {
+                in_node->next = pos->next;
+                in_node->prev = pos;
+                if (pos->next)
+                    pos->next->prev = in_node;
+                else
+                    tail = in_node;
+                pos->next = in_node;
+            }
+        }
+    }
+
+    head->prev = NULL;
+    head->next->prev = (struct list_head *) len;
+    result.head = head, result.next = next;
+    return result;
+}
+
+static struct list_head *merge_at(void *priv,
+                                  list_cmp_func_t cmp,
+                                  bool descend,
+                                  struct list_head *at)
+{
+    size_t len = run_size(at) + run_size(at->prev);
+    struct list_head *prev = at->prev->prev;
+    struct list_head *list = merge(priv, cmp, descend, at->prev, at);
+    list->prev = prev;
+    list->next->prev = (struct list_head *) len;
+    --stk_size;
+    return list;
+}
+
+static struct list_head *merge_force_collapse(void *priv,
+                                              list_cmp_func_t cmp,
+                                              bool descend,
+                                              struct list_head *tp)
+{
+    while (stk_size >= 3) {
+        if (run_size(tp->prev->prev) < run_size(tp)) {
+            tp->prev = merge_at(priv, cmp, descend, tp->prev);
+        } else {
+            tp = merge_at(priv, cmp, descend, tp);
+        }
+    }
+    return tp;
+}
+
+static struct list_head *merge_collapse(void *priv,
+                                        list_cmp_func_t cmp,
+                                        bool descend,
+                                        struct list_head *tp)
+{
+    int n;
+    while ((n = stk_size) >= 2) {
+        if ((n >= 3 &&
+             run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
+            (n >= 4 && run_size(tp->prev->prev->prev) <=
+                           run_size(tp->prev->prev) + run_size(tp->prev))) {
+            if (run_size(tp->prev->prev) < run_size(tp)) {
+                tp->prev = merge_at(priv, cmp, descend, tp->prev);
+            } else {
+                tp = merge_at(priv, cmp, descend, tp);
+            }
+        } else if (run_size(tp->prev) <= run_size(tp)) {
+            tp = merge_at(priv, cmp, descend, tp);
+        } else {
+            break;
+        }
+    }
+
+    return tp;
+}
+
+static int find_minrun_g(int size)
+{
+    int one = 0;
+    if (size) {
+        // To get the first five bits (MAX_MINRUN = 32)
+        while (size > 0x001F) {
+            one = (size & 0x01) ? 1 : one;  // holding carry
+            size >>= 1;
+        }
+    }
+
+    return size + one;
+}
+
+void timsort_gallop(void *priv,
+                    struct list_head *head,
+                    bool descend,
+                    list_cmp_func_t cmp)
+{
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    stk_size = 0;
+    min_gallop = MIN_GALLOP;
+    minrun_g = find_minrun_g(list_length(head));
+
+    struct list_head *list = head->next, *tp = NULL;
+
+    /* Convert to a null-terminated singly-linked list. */
+    head->prev->next = NULL;
+
+    do {
+        /* Find next run */
+        struct pair result = find_run(priv, list, cmp, descend);
+        result.head->prev = tp;
+        tp = result.head;
+        list = result.next;
+        stk_size++;
+        tp = merge_collapse(priv, cmp, descend, tp);
+    } while (list);
+
+    /* End of input; merge together all the runs. */
+    tp = merge_force_collapse(priv, cmp, descend, tp);
+
+    /* The final merge; rebuild prev links */
+    struct list_head *stk0 = tp, *stk1 = stk0->prev;
+    while (stk1 && stk1->prev)
+        stk0 = stk0->prev, stk1 = stk1->prev;
+    if (stk_size <= 1) {
+        build_prev_link(head, head, stk0);
+        return;
+    }
+    merge_final(priv, cmp, descend, head, stk1, stk0);
+}
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,9 +21,9 @@ struct pair {
 };
 
 static size_t stk_size;
-
 static struct list_head *merge(void *priv,
                                list_cmp_func_t cmp,
+                               bool descend,
                                struct list_head *a,
                                struct list_head *b)
 {
@@ -31,7 +32,7 @@ static struct list_head *merge(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             *tail = a;
             tail = &a->next;
             a = a->next;
@@ -70,6 +71,7 @@ static void build_prev_link(struct list_head *head,
 
 static void merge_final(void *priv,
                         list_cmp_func_t cmp,
+                        bool descend,
                         struct list_head *head,
                         struct list_head *a,
                         struct list_head *b)
@@ -78,7 +80,7 @@ static void merge_final(void *priv,
 
     for (;;) {
         /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
+        if (sort_cmp(priv, cmp, descend, a, b) <= 0) {
             tail->next = a;
             a->prev = tail;
             tail = a;
@@ -103,7 +105,8 @@ static void merge_final(void *priv,
 
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            bool descend)
 {
     // printf("start find run\n");
     size_t len = 1;
@@ -115,7 +118,7 @@ static struct pair find_run(void *priv,
         return result;
     }
 
-    if (cmp(priv, list, next) > 0) {
+    if (sort_cmp(priv, cmp, descend, list, next) > 0) {
         /* decending run, also reverse the list */
         struct list_head *prev = NULL;
         do {
@@ -125,7 +128,7 @@ static struct pair find_run(void *priv,
             list = next;
             next = list->next;
             head = list;
-        } while (next && cmp(priv, list, next) > 0);
+        } while (next && sort_cmp(priv, cmp, descend, list, next) > 0);
         list->next = prev;
         // printf("\nreverse\n");
     } else {
@@ -133,7 +136,7 @@ static struct pair find_run(void *priv,
             len++;
             list = next;
             next = list->next;
-        } while (next && cmp(priv, list, next) <= 0);
+        } while (next && sort_cmp(priv, cmp, descend, list, next) <= 0);
         list->next = NULL;
     }
 
@@ -145,11 +148,12 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
+                                  bool descend,
                                   struct list_head *at)
 {
     size_t len = run_size(at) + run_size(at->prev);
     struct list_head *prev = at->prev->prev;
-    struct list_head *list = merge(priv, cmp, at->prev, at);
+    struct list_head *list = merge(priv, cmp, descend, at->prev, at);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
     --stk_size;
@@ -158,13 +162,14 @@ static struct list_head *merge_at(void *priv,
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
+                                              bool descend,
                                               struct list_head *tp)
 {
     while (stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, descend, tp->prev);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, descend, tp);
         }
     }
     return tp;
@@ -172,6 +177,7 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
+                                        bool descend,
                                         struct list_head *tp)
 {
     int n;
@@ -181,12 +187,12 @@ static struct list_head *merge_collapse(void *priv,
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, descend, tp->prev);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, descend, tp);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, descend, tp);
         } else {
             break;
         }
@@ -195,7 +201,10 @@ static struct list_head *merge_collapse(void *priv,
     return tp;
 }
 
-void timsort_old(void *priv, struct list_head *head, list_cmp_func_t cmp)
+void timsort_old(void *priv,
+                 struct list_head *head,
+                 bool descend,
+                 list_cmp_func_t cmp)
 {
     if (!head || list_empty(head) || list_is_singular(head))
         return;
@@ -211,16 +220,16 @@ void timsort_old(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, descend);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
         stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        tp = merge_collapse(priv, cmp, descend, tp);
     } while (list);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, descend, tp);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
@@ -230,5 +239,5 @@ void timsort_old(void *priv, struct list_head *head, list_cmp_func_t cmp)
         build_prev_link(head, head, stk0);
         return;
     }
-    merge_final(priv, cmp, head, stk1, stk0);
+    merge_final(priv, cmp, descend, head, stk1, stk0);
 }
\ No newline at end of file
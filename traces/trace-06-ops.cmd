@@ -1,4 +1,5 @@
-# Test of insert_head, insert_tail, delete duplicate, sort, descend and reverseK
+# Test of insert_head, insert_tail, delete duplicate, sort, descend, reverseK
+# and sortascend
 new
 ih RAND 4
 it gerbil 3
@@ -35,3 +36,13 @@ rh b
 rh c
 rh a
 rh a
+free
+new
+it b
+it c
+it b
+it a
+option descend 1
+sortascend
+rh a
+option descend 0
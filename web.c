@@ -4,16 +4,29 @@
 
 #include <arpa/inet.h> /* inet_ntoa */
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/tcp.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h> /* strncasecmp */
 #include <sys/socket.h>
 #include <unistd.h>
 
-#define LISTENQ 1024 /* second argument to listen() */
-#define MAXLINE 1024 /* max length of a line */
-#define BUFSIZE 1024
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "list.h"
+
+#define LISTENQ 1024  /* second argument to listen() */
+#define MAXLINE 1024  /* max length of a line */
+#define BUFSIZE 8192  /* room for the headers of the requests received */
+#define MAX_EVENTS 64 /* descriptors reported ready at once */
 
 #ifndef DEFAULT_PORT
 #define DEFAULT_PORT 9999 /* use this port if none given as arg to main() */
@@ -25,57 +38,157 @@
 
 static int server_fd;
 
-typedef struct {
-    int fd;            /* descriptor for this buf */
-    int count;         /* unread byte in this buf */
-    char *bufptr;      /* next unread byte in this buf */
-    char buf[BUFSIZE]; /* internal buffer */
-} rio_t;
+/* The command of the connection being answered, whose report() output is
+ * streamed back. Defined in console.c. */
+extern int web_connfd;
 
+/* A client connection, which is kept open across requests if it asks for
+ * HTTP/1.1 keep-alive. The received bytes are buffered in blocks, so that
+ * several requests sent at once are taken one by one. The socket does not
+ * block, and the response is buffered until the client takes it, so that a
+ * client which stops reading holds back nobody else. */
 typedef struct {
-    char filename[512];
-    off_t offset; /* for support Range */
-    size_t end;
-} http_request_t;
+    int fd;                /* descriptor of the connection */
+    size_t len;            /* received bytes not parsed yet */
+    bool keep_alive;       /* keep the connection after the response */
+    bool eof;              /* the client is done sending */
+    bool closing;          /* close the connection once the response is sent */
+    bool push;             /* push the response out once it is sent */
+    bool broken;           /* the response cannot be sent */
+    bool watch_in;         /* watched for the bytes received */
+    bool watch_out;        /* watched for room to send */
+    char *out;             /* bytes of the response not sent yet */
+    size_t out_len;        /* length of @out */
+    size_t out_size;       /* room allocated for @out */
+    struct list_head link; /* in the queue while a request is complete */
+    char buf[BUFSIZE];     /* internal buffer */
+} web_conn_t;
+
+/* The connections indexed by their descriptors */
+static web_conn_t **conns;
+static int conns_size;
+
+/* The connections with a complete request, which take turns to run one
+ * command each, so that a client sending many at once does not hold back
+ * the others */
+static LIST_HEAD(ready_queue);
+
+/* The connection whose command is being run, NULL if none */
+static web_conn_t *current;
+
+/* Whether the standard input is watched for readiness. A regular file is
+ * always ready and cannot be watched. */
+static bool stdin_watched;
+
+/* Whether a waiting web request goes before the standard input which is not
+ * watched, so that the two take turns instead of the web clients starving */
+static bool web_turn;
+
+/* The descriptors watched stay registered from one wait to the next, with
+ * epoll or else the array given to poll(). They are watched for reading when
+ * added, and a connection changes what it is watched for with event_watch().
+ */
+#if defined(__linux__)
+static int event_fd = -1;
 
-static void rio_readinitb(rio_t *rp, int fd)
+static bool event_add(int fd)
 {
-    rp->fd = fd;
-    rp->count = 0;
-    rp->bufptr = rp->buf;
+    if (event_fd < 0 && (event_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return false;
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+    return !epoll_ctl(event_fd, EPOLL_CTL_ADD, fd, &ev);
 }
 
-/* This is a wrapper for the Unix read() function that transfers min(n, count)
- * bytes from an internal buffer to a user buffer, where n is the number of
- * bytes requested by the user and count is the number of unread bytes in the
- * internal buffer. On entry, rio_read() refills the internal buffer via a call
- * to read() if the internal buffer is empty.
- */
-/* $begin rio_read */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
+static void event_watch(int fd, bool in, bool out)
 {
-    int cnt;
-    while (rp->count <= 0) { /* refill if buf is empty */
-        rp->count = read(rp->fd, rp->buf, sizeof(rp->buf));
-        if (rp->count < 0) {
-            if (errno != EINTR) /* interrupted by sig handler return */
-                return -1;
-        } else if (rp->count == 0) { /* EOF */
-            return 0;
-        } else
-            rp->bufptr = rp->buf; /* reset buffer ptr */
+    struct epoll_event ev = {
+        .events = (in ? EPOLLIN : 0) | (out ? EPOLLOUT : 0),
+        .data.fd = fd,
+    };
+    epoll_ctl(event_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+static void event_del(int fd)
+{
+    struct epoll_event ev = {0};
+    epoll_ctl(event_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+/* Store the descriptors ready in @fds and return their number */
+static int event_wait(int *fds, int timeout)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(event_fd, events, MAX_EVENTS, timeout);
+    for (int i = 0; i < n; i++)
+        fds[i] = events[i].data.fd;
+    return n;
+}
+
+static void event_close(void)
+{
+    if (event_fd >= 0)
+        close(event_fd);
+    event_fd = -1;
+}
+#else
+static struct pollfd *event_fds;
+static int event_cnt, event_size;
+
+static bool event_add(int fd)
+{
+    if (event_cnt == event_size) {
+        int size = event_size ? event_size * 2 : MAX_EVENTS;
+        struct pollfd *fds = realloc(event_fds, size * sizeof(*fds));
+        if (!fds)
+            return false;
+        event_fds = fds;
+        event_size = size;
+    }
+    event_fds[event_cnt++] = (struct pollfd){.fd = fd, .events = POLLIN};
+    return true;
+}
+
+static void event_watch(int fd, bool in, bool out)
+{
+    for (int i = 0; i < event_cnt; i++) {
+        if (event_fds[i].fd == fd) {
+            event_fds[i].events = (in ? POLLIN : 0) | (out ? POLLOUT : 0);
+            return;
+        }
     }
+}
 
-    /* Copy min(n, rp->count) bytes from internal buf to user buf */
-    cnt = n;
-    if (rp->count < n)
-        cnt = rp->count;
-    memcpy(usrbuf, rp->bufptr, cnt);
-    rp->bufptr += cnt;
-    rp->count -= cnt;
-    return cnt;
+static void event_del(int fd)
+{
+    for (int i = 0; i < event_cnt; i++) {
+        if (event_fds[i].fd == fd) {
+            event_fds[i] = event_fds[--event_cnt];
+            return;
+        }
+    }
 }
 
+/* Store the descriptors ready in @fds and return their number */
+static int event_wait(int *fds, int timeout)
+{
+    if (poll(event_fds, event_cnt, timeout) < 0)
+        return -1;
+    int n = 0;
+    for (int i = 0; i < event_cnt && n < MAX_EVENTS; i++) {
+        if (event_fds[i].revents)
+            fds[n++] = event_fds[i].fd;
+    }
+    return n;
+}
+
+static void event_close(void)
+{
+    free(event_fds);
+    event_fds = NULL;
+    event_cnt = event_size = 0;
+}
+#endif
+
 static ssize_t writen(int fd, void *usrbuf, size_t n)
 {
     size_t nleft = n;
@@ -95,32 +208,67 @@ static ssize_t writen(int fd, void *usrbuf, size_t n)
     return n;
 }
 
-/* robustly read a text line (buffered) */
-static ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
+/* Append @len bytes at @buf to the response of @c */
+static void conn_write(web_conn_t *c, const char *buf, size_t len)
 {
-    char c, *bufp = usrbuf;
-
-    int n;
-    for (n = 1; n < maxlen; n++) {
-        int rc;
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-            *bufp++ = c;
-            if (c == '\n')
-                break;
-        } else if (rc == 0) {
-            if (n == 1)
-                return 0; /* EOF, no data read */
-            break;        /* EOF, some data was read */
-        } else
-            return -1; /* error */
+    if (c->broken)
+        return;
+    if (c->out_len + len > c->out_size) {
+        size_t size = c->out_size ? c->out_size : BUFSIZE;
+        while (size < c->out_len + len)
+            size *= 2;
+        char *out = realloc(c->out, size);
+        if (!out) {
+            c->broken = true; /* the response would be cut short */
+            return;
+        }
+        c->out = out;
+        c->out_size = size;
+    }
+    memcpy(c->out + c->out_len, buf, len);
+    c->out_len += len;
+}
+
+/* Send what the socket takes of the response of @c without blocking */
+static void conn_flush(web_conn_t *c)
+{
+    size_t sent = 0;
+    while (!c->broken && sent < c->out_len) {
+        ssize_t n = write(c->fd, c->out + sent, c->out_len - sent);
+        if (n >= 0)
+            sent += n;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break; /* the rest goes once the client takes some */
+        else if (errno != EINTR)
+            c->broken = true;
+    }
+    if (c->broken) {
+        c->out_len = 0;
+    } else if (sent) {
+        c->out_len -= sent;
+        memmove(c->out, c->out + sent, c->out_len);
     }
-    *bufp = 0;
-    return n;
 }
 
+/* Send @buf to @out_fd, as a chunk of the response if it is the connection
+ * being answered with keep-alive */
 void web_send(int out_fd, char *buf)
 {
-    writen(out_fd, buf, strlen(buf));
+    size_t len = strlen(buf);
+    if (!current || out_fd != current->fd) {
+        writen(out_fd, buf, len);
+        return;
+    }
+    if (!current->keep_alive) {
+        conn_write(current, buf, len);
+    } else if (len) { /* an empty chunk would end the response */
+        char size[32];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+        conn_write(current, size, n);
+        conn_write(current, buf, len);
+        conn_write(current, "\r\n", 2);
+    }
+    conn_flush(current);
 }
 
 int web_open(int port)
@@ -156,8 +304,19 @@ int web_open(int port)
     if (listen(listenfd, LISTENQ) < 0)
         return -1;
 
+    /* Accept the clients until none is left waiting */
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK) < 0)
+        return -1;
+
+    if (!event_add(listenfd))
+        return -1;
+    stdin_watched = event_add(STDIN_FILENO);
+
     server_fd = listenfd;
 
+    /* A client closing its connection early must not kill the program */
+    signal(SIGPIPE, SIG_IGN);
+
     return listenfd;
 }
 
@@ -177,27 +336,198 @@ static void url_decode(char *src, char *dest, int max)
     *dest = '\0';
 }
 
-static void parse_request(int fd, http_request_t *req)
+static void conn_close(web_conn_t *c)
 {
-    rio_t rio;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE];
-    req->offset = 0;
-    req->end = 0; /* default */
-
-    rio_readinitb(&rio, fd);
-    rio_readlineb(&rio, buf, MAXLINE);
-    sscanf(buf, "%1023s %1023s", method, uri); /* version is not cared */
-    /* read all */
-    while (buf[0] != '\n' && buf[1] != '\n') { /* \n || \r\n */
-        rio_readlineb(&rio, buf, MAXLINE);
-        if (buf[0] == 'R' && buf[1] == 'a' && buf[2] == 'n') {
-            sscanf(buf, "Range: bytes=%lu-%lu", (unsigned long *) &req->offset,
-                   (unsigned long *) &req->end);
-            /* Range: [start, end] */
-            if (req->end != 0)
-                req->end++;
+    if (c == current)
+        current = NULL;
+    event_del(c->fd);
+    close(c->fd);
+    list_del(&c->link);
+    conns[c->fd] = NULL;
+    free(c->out);
+    free(c);
+}
+
+static void conn_accept(void)
+{
+    for (;;) {
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0)
+            return;
+
+        /* The connection does not inherit O_NONBLOCK everywhere */
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+            close(fd);
+            continue;
         }
+
+        if (fd >= conns_size) {
+            int size = fd >= conns_size * 2 ? fd + 1 : conns_size * 2;
+            web_conn_t **p = realloc(conns, size * sizeof(*p));
+            if (!p) {
+                close(fd);
+                continue;
+            }
+            memset(p + conns_size, 0, (size - conns_size) * sizeof(*p));
+            conns = p;
+            conns_size = size;
+        }
+
+        web_conn_t *c = malloc(sizeof(web_conn_t));
+        if (!c || !event_add(fd)) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->len = 0;
+        c->keep_alive = false;
+        c->eof = false;
+        c->closing = false;
+        c->push = false;
+        c->broken = false;
+        c->watch_in = true;
+        c->watch_out = false;
+        c->out = NULL;
+        c->out_len = c->out_size = 0;
+        INIT_LIST_HEAD(&c->link);
+        conns[fd] = c;
+    }
+}
+
+/* Find the end of the headers of the first request in the buffer, and return
+ * its length including the empty line, or 0 if it is incomplete */
+static size_t request_length(const web_conn_t *c)
+{
+    const char *end = c->buf + c->len;
+    for (const char *p = c->buf; (p = memchr(p, '\n', end - p)); p++) {
+        size_t rest = end - p;
+        if (rest >= 2 && p[1] == '\n')
+            return p + 2 - c->buf;
+        if (rest >= 3 && p[1] == '\r' && p[2] == '\n')
+            return p + 3 - c->buf;
+    }
+    return 0;
+}
+
+/* Once the last response is sent, queue the connection if it has a complete
+ * request, or close it if it will have none. Then watch it for what it is
+ * waiting for: room to send the rest of the response, or more requests while
+ * its buffer has room. */
+static void conn_update(web_conn_t *c)
+{
+    if (c->broken) {
+        conn_close(c);
+        return;
+    }
+    if (!c->out_len) {
+        if (c->closing) {
+            conn_close(c);
+            return;
+        }
+        if (c->push) {
+            /* Push the response out rather than after the delay of
+             * TCP_CORK */
+            int optval = 0;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+            optval = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+            c->push = false;
+        }
+        if (request_length(c)) {
+            if (list_empty(&c->link))
+                list_add_tail(&c->link, &ready_queue);
+        } else if (c->eof || c->len == sizeof(c->buf)) {
+            conn_close(c); /* or the headers of the request do not fit */
+            return;
+        }
+    }
+
+    bool in = !c->eof && c->len < sizeof(c->buf);
+    bool out = c->out_len;
+    if (in != c->watch_in || out != c->watch_out)
+        event_watch(c->fd, in, out);
+    c->watch_in = in;
+    c->watch_out = out;
+}
+
+/* Send the rest of the response and read what the client has sent. A client
+ * which is done sending is not watched for reading anymore, and its
+ * connection is closed once its requests are answered. */
+static void conn_event(web_conn_t *c)
+{
+    conn_flush(c);
+    if (!c->broken && !c->eof && c->len < sizeof(c->buf)) {
+        ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n > 0)
+            c->len += n;
+        else if (!n || (errno != EINTR && errno != EAGAIN &&
+                        errno != EWOULDBLOCK))
+            c->eof = true;
+    }
+    conn_update(c);
+}
+
+/* End the response of the last command, which is pushed out once it is sent.
+ * The connection takes its turn again if it has another request. */
+static void web_finish(void)
+{
+    web_conn_t *c = current;
+    if (!c)
+        return;
+    web_connfd = 0;
+    current = NULL;
+    if (c->keep_alive) {
+        conn_write(c, "0\r\n\r\n", 5);
+        c->push = true;
+    } else {
+        c->closing = true;
+    }
+    conn_flush(c);
+    conn_update(c);
+}
+
+/* Take the value of the header @name from the line at @line, or NULL */
+static char *header_value(char *line, const char *name)
+{
+    size_t len = strlen(name);
+    if (strncasecmp(line, name, len) || line[len] != ':')
+        return NULL;
+    line += len + 1;
+    while (*line == ' ' || *line == '\t')
+        line++;
+    return line;
+}
+
+/* Parse a complete request of @len bytes from the connection @c, whose lines
+ * are split in place. The command in its URI is stored in @cmd. */
+static void parse_request(web_conn_t *c, char *req, size_t len, char *cmd)
+{
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE] = "";
+    req[len] = '\0';
+
+    char *line = req, *next = memchr(req, '\n', len);
+    *next++ = '\0';
+    if (sscanf(line, "%1023s %1023s %1023s", method, uri, version) < 2)
+        uri[0] = '\0';
+    /* The response of a kept connection is chunked, which only HTTP/1.1
+     * clients support, so an HTTP/1.0 connection is closed after it even if
+     * it asks for keep-alive */
+    c->keep_alive = !strncmp(version, "HTTP/1.1", 8);
+
+    for (line = next; line < req + len; line = next) {
+        next = memchr(line, '\n', req + len - line);
+        if (!next)
+            break;
+        *next++ = '\0';
+        if (next - line >= 2 && next[-2] == '\r')
+            next[-2] = '\0';
+
+        char *value = header_value(line, "Connection");
+        if (value && !strncasecmp(value, "close", 5))
+            c->keep_alive = false;
     }
+
     char *filename = uri;
     if (uri[0] == '/') {
         filename = uri + 1;
@@ -213,58 +543,109 @@ static void parse_request(int fd, http_request_t *req)
             }
         }
     }
-    url_decode(filename, req->filename, MAXLINE);
-}
+    url_decode(filename, cmd, MAXLINE);
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr)
-{
-    http_request_t req;
-    parse_request(fd, &req);
-
-    char *p = req.filename;
     /* Change '/' to ' ' */
-    while (*p) {
-        ++p;
-        if (*p == '/')
+    for (char *p = cmd; *p; p++) {
+        if (*p == '/' && p != cmd)
             *p = ' ';
     }
-    char *ret = malloc(strlen(req.filename) + 1);
-    strncpy(ret, req.filename, strlen(req.filename) + 1);
+}
 
-    return ret;
+/* Take the next request of the queue, answer it with the header and return
+ * the length of its command stored in @buf, or -1 if it has no command */
+static int web_dispatch(char *buf)
+{
+    web_conn_t *c = list_first_entry(&ready_queue, web_conn_t, link);
+    list_del_init(&c->link);
+
+    size_t len = request_length(c);
+    char req[BUFSIZE + 1];
+    memcpy(req, c->buf, len);
+    c->len -= len;
+    memmove(c->buf, c->buf + len, c->len);
+    parse_request(c, req, len, buf);
+
+    char *header = c->keep_alive ? "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain\r\n"
+                                   "Transfer-Encoding: chunked\r\n\r\n"
+                                 : "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain\r\n"
+                                   "Connection: close\r\n\r\n";
+    conn_write(c, header, strlen(header));
+    conn_flush(c);
+    current = c;
+    if (!*buf)
+        return -1;
+    web_connfd = c->fd;
+    return strlen(buf);
 }
 
+/* Wait for a command from either the standard input or the web server. Any
+ * number of clients are served at once, and the connections with a complete
+ * request take turns to run a command each.
+ * Return the length of the command from the web stored in @buf, or 0 if the
+ * standard input is ready to be read.
+ */
 int web_eventmux(char *buf)
 {
-    fd_set listenset;
+    /* The last command is done once the console asks for the next one */
+    web_finish();
+
+    for (;;) {
+        /* Do not block while a request is waiting, but still take what the
+         * other clients have sent, so that they queue up behind it */
+        int fds[MAX_EVENTS];
+        bool block = stdin_watched && list_empty(&ready_queue);
+        int n = event_wait(fds, block ? -1 : 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
 
-    FD_ZERO(&listenset);
-    FD_SET(STDIN_FILENO, &listenset);
-    int max_fd = STDIN_FILENO;
-    if (server_fd > 0) {
-        FD_SET(server_fd, &listenset);
-        max_fd = max_fd > server_fd ? max_fd : server_fd;
-    }
-    int result = select(max_fd + 1, &listenset, NULL, NULL, NULL);
-    if (result < 0)
-        return -1;
+        bool stdin_ready = false;
+        for (int i = 0; i < n; i++) {
+            if (fds[i] == STDIN_FILENO)
+                stdin_ready = true;
+            else if (fds[i] == server_fd)
+                conn_accept();
+            else if (fds[i] < conns_size && conns[fds[i]])
+                conn_event(conns[fds[i]]);
+        }
+        if (!stdin_watched) {
+            stdin_ready = !web_turn || list_empty(&ready_queue);
+            web_turn = stdin_ready;
+        }
+        if (stdin_ready)
+            return 0;
 
-    if (server_fd > 0 && FD_ISSET(server_fd, &listenset)) {
-        FD_CLR(server_fd, &listenset);
-        struct sockaddr_in clientaddr;
-        socklen_t clientlen = sizeof(clientaddr);
-        int web_connfd =
-            accept(server_fd, (struct sockaddr *) &clientaddr, &clientlen);
-
-        char *p = web_recv(web_connfd, &clientaddr);
-        char *buffer = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n";
-        web_send(web_connfd, buffer);
-        strncpy(buf, p, strlen(p) + 1);
-        free(p);
-        close(web_connfd);
-        return strlen(buf);
+        if (!list_empty(&ready_queue)) {
+            int len = web_dispatch(buf);
+            if (len > 0)
+                return len;
+            web_finish();
+        }
     }
+}
 
-    FD_CLR(STDIN_FILENO, &listenset);
-    return 0;
+/* Finish the response in progress and close the connections, with what
+ * the clients take of their responses at once */
+void web_close(void)
+{
+    web_finish();
+    for (int fd = 0; fd < conns_size; fd++) {
+        if (conns[fd]) {
+            conn_flush(conns[fd]);
+            conn_close(conns[fd]);
+        }
+    }
+    free(conns);
+    conns = NULL;
+    conns_size = 0;
+    if (server_fd > 0) {
+        close(server_fd);
+        server_fd = 0;
+    }
+    event_close();
 }
@@ -5,10 +5,10 @@
 
 int web_open(int port);
 
-char *web_recv(int fd, struct sockaddr_in *clientaddr);
-
 void web_send(int out_fd, char *buffer);
 
 int web_eventmux(char *buf);
 
+void web_close(void);
+
 #endif